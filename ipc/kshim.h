@@ -0,0 +1,200 @@
+#ifndef KSHIM_H
+#define KSHIM_H
+
+// User-space stand-ins for the kernel APIs message_slot.c uses, so the slot/channel logic builds unmodified into
+// libmessage_slot.a (see message_slot_user.h). Only what the driver needs is here, with kernel signatures and
+// error conventions (negative errno, ERR_PTR). Memory comes from malloc, locks from pthreads.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef unsigned short umode_t;
+
+#define PAGE_SIZE 4096
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+// ---------- kernel.h / module.h / init.h ----------
+#define KERN_ERR "<3>"
+#define KERN_INFO "<6>"
+#define printk(...) fprintf(stderr, __VA_ARGS__)
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define __init
+#define __exit
+#define THIS_MODULE NULL
+#define MODULE_LICENSE(license)
+// module_init/exit become the library's entry points (msl_init/msl_exit call them)
+#define module_init(fn) int kshim_module_init(void) { return fn(); }
+#define module_exit(fn) void kshim_module_exit(void) { fn(); }
+
+// ---------- err.h ----------
+#define MAX_ERRNO 4095
+static inline void *ERR_PTR(long error) { return (void *)error; }
+static inline long PTR_ERR(const void *ptr) { return (long)ptr; }
+static inline int IS_ERR(const void *ptr) { return (unsigned long)ptr >= (unsigned long)-MAX_ERRNO; }
+static inline int IS_ERR_OR_NULL(const void *ptr) { return !ptr || IS_ERR(ptr); }
+
+// ---------- slab.h ----------
+typedef unsigned int gfp_t;
+#define GFP_KERNEL 0u
+
+static inline void *kmalloc(size_t size, gfp_t flags) { (void)flags; return malloc(size); }
+static inline void *kzalloc(size_t size, gfp_t flags) { (void)flags; return calloc(1, size); }
+static inline void kfree(const void *p) { free((void *)p); }
+char *kasprintf(gfp_t gfp, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+struct kmem_cache;
+struct kmem_cache *kmem_cache_create_usercopy(const char *name, unsigned int size, unsigned int align,
+                                              unsigned int flags, unsigned int useroffset, unsigned int usersize,
+                                              void (*ctor)(void *));
+void *kmem_cache_alloc(struct kmem_cache *cache, gfp_t flags);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+void kmem_cache_destroy(struct kmem_cache *cache);
+
+// ---------- mutex.h ----------
+struct mutex {
+    pthread_mutex_t m;
+};
+#define DEFINE_MUTEX(name) struct mutex name = {PTHREAD_MUTEX_INITIALIZER}
+#define mutex_init(lock) pthread_mutex_init(&(lock)->m, NULL)
+#define mutex_lock(lock) pthread_mutex_lock(&(lock)->m)
+#define mutex_unlock(lock) pthread_mutex_unlock(&(lock)->m)
+
+// ---------- jiffies.h ----------
+#define HZ 1000
+#define jiffies kshim_jiffies()
+unsigned long kshim_jiffies(void); // CLOCK_MONOTONIC in milliseconds
+#define time_after(a, b) ((long)((b) - (a)) < 0)
+
+// ---------- workqueue.h ----------
+// Delayed works run on one shim thread, started by the first schedule_delayed_work()
+struct work_struct {
+    int unused;
+};
+struct delayed_work {
+    struct work_struct work;
+    void (*func)(struct work_struct *work);
+    unsigned long due; // jiffies
+    int pending, running, canceling;
+    struct delayed_work *next; // on the shim's pending list
+};
+#define DECLARE_DELAYED_WORK(name, fn) struct delayed_work name = {.func = (fn)}
+int schedule_delayed_work(struct delayed_work *dwork, unsigned long delay);
+int cancel_delayed_work_sync(struct delayed_work *dwork);
+
+// ---------- percpu.h ----------
+// KSHIM_NR_CPUS copies laid out KSHIM_PERCPU_STRIDE bytes apart, a thread updates the copy of the CPU it runs on.
+// The update is atomic because, unlike in the kernel, nothing stops the thread from migrating halfway through.
+#define KSHIM_NR_CPUS 64
+#define KSHIM_PERCPU_STRIDE 128
+#define __percpu
+void *kshim_alloc_percpu(size_t size); // NULL if size > KSHIM_PERCPU_STRIDE
+int kshim_this_cpu(void);
+#define alloc_percpu(type) ((type *)kshim_alloc_percpu(sizeof(type)))
+#define free_percpu(ptr) free(ptr)
+#define per_cpu_ptr(ptr, cpu) ((__typeof__(ptr))((char *)(ptr) + (size_t)(cpu) * KSHIM_PERCPU_STRIDE))
+#define this_cpu_add(pcp, val) \
+    __atomic_fetch_add((__typeof__(&(pcp)))((char *)&(pcp) + (size_t)kshim_this_cpu() * KSHIM_PERCPU_STRIDE), \
+                       (val), __ATOMIC_RELAXED)
+#define this_cpu_inc(pcp) this_cpu_add(pcp, 1)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < KSHIM_NR_CPUS; (cpu)++)
+
+// ---------- uaccess.h / uio.h ----------
+// "user" buffers are ordinary pointers in the library
+static inline unsigned long copy_from_user(void *to, const void *from, unsigned long n) {
+    memcpy(to, from, n);
+    return 0;
+}
+static inline unsigned long copy_to_user(void *to, const void *from, unsigned long n) {
+    memcpy(to, from, n);
+    return 0;
+}
+
+struct iov_iter {
+    const struct iovec *iov;
+    unsigned long nr_segs;
+    size_t iov_offset; // consumed bytes of iov[0]
+    size_t count; // bytes left in total
+};
+static inline size_t iov_iter_count(const struct iov_iter *i) { return i->count; }
+size_t copy_from_iter(void *addr, size_t bytes, struct iov_iter *i);
+size_t copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i);
+
+// ---------- fs.h ----------
+struct inode {
+    unsigned int minor;
+};
+struct file {
+    struct inode *f_inode;
+    void *private_data;
+};
+struct kiocb {
+    struct file *ki_filp;
+};
+static inline unsigned int iminor(const struct inode *inode) { return inode->minor; }
+static inline struct inode *file_inode(const struct file *f) { return f->f_inode; }
+
+struct seq_file;
+
+struct file_operations {
+    void *owner;
+    int (*show)(struct seq_file *m, void *v); // shim only: the show function of a DEFINE_SHOW_ATTRIBUTE file
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+    ssize_t (*read_iter)(struct kiocb *, struct iov_iter *);
+    ssize_t (*write_iter)(struct kiocb *, struct iov_iter *);
+    long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+};
+int register_chrdev(unsigned int major, const char *name, const struct file_operations *fops);
+void unregister_chrdev(unsigned int major, const char *name);
+
+// ---------- seq_file.h / debugfs.h ----------
+// debugfs files are kept in a table and rendered by msl_debugfs_read()
+struct seq_file {
+    char *buf;
+    size_t size, count;
+    void *private; // the data pointer given to debugfs_create_file
+};
+int seq_printf(struct seq_file *m, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void seq_puts(struct seq_file *m, const char *s);
+#define DEFINE_SHOW_ATTRIBUTE(name) static const struct file_operations name##_fops = {.show = name##_show}
+
+struct dentry;
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, umode_t mode, struct dentry *parent, void *data,
+                                   const struct file_operations *fops);
+void debugfs_remove_recursive(struct dentry *dentry);
+
+// ---------- kobject.h / sysfs.h ----------
+// attributes are rendered by msl_sysfs_read()
+struct kobject;
+struct attribute {
+    const char *name;
+    umode_t mode;
+};
+struct kobj_attribute {
+    struct attribute attr;
+    ssize_t (*show)(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+    ssize_t (*store)(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
+};
+#define __ATTR(_name, _mode, _show, _store) {.attr = {.name = #_name, .mode = (_mode)}, .show = (_show), .store = (_store)}
+struct attribute_group {
+    const char *name;
+    struct attribute **attrs;
+};
+extern struct kobject *kernel_kobj;
+struct kobject *kobject_create_and_add(const char *name, struct kobject *parent);
+void kobject_put(struct kobject *kobj);
+int sysfs_create_group(struct kobject *kobj, const struct attribute_group *grp);
+int sysfs_emit(char *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif //KSHIM_H
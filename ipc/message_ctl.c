@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "message_slot.h"
+
+// slot-wide controls: channel deletion, idle eviction and memory limits
+static const struct {
+    const char *name;
+    unsigned long cmd;
+} commands[] = {
+    {"del", MSG_SLOT_DEL_CHANNEL},
+    {"idle", MSG_SLOT_SET_IDLE_TIMEOUT},
+    {"max-channels", MSG_SLOT_SET_MAX_CHANNELS},
+    {"max-bytes", MSG_SLOT_SET_MAX_BYTES},
+};
+
+int main(int argc, char *argv[]) {
+    unsigned long cmd = 0;
+    unsigned int value;
+    size_t i;
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <file> <del|idle|max-channels|max-bytes> <value>\n", argv[0]);
+        return 1;
+    }
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+        if (strcmp(argv[2], commands[i].name) == 0)
+            cmd = commands[i].cmd;
+    if (!cmd) {
+        fprintf(stderr, "unknown command: %s\n", argv[2]);
+        return 1;
+    }
+    value = (unsigned int) strtoul(argv[3], NULL, 0);
+
+    int fd = open(argv[1], O_RDWR);
+    if (fd < 0) {
+        perror("an error occurred during open");
+        return 1;
+    }
+    if (ioctl(fd, cmd, value)) {
+        perror("an error occurred during ioctl");
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
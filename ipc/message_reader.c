@@ -7,7 +7,7 @@
 
 int main(int argc, char *argv[]) {
     unsigned int channel_id;
-    char buf[MESSAGE_MAX_LEN];
+    char buf[MESSAGE_MAX_LEN_LIMIT]; // big enough for any slot configuration
     if (argc != 3) {
         fprintf(stderr, "Usage: %s <file> <channel>\n", argv[0]);
         return 1;
@@ -8,14 +8,16 @@
 
 
 int main(int argc, char *argv[]) {
-    unsigned int channel_id, censor_mode;
-    if (argc != 5) {
-        fprintf(stderr, "Usage: %s <file> <channel> <censor 0|1> <message>\n", argv[0]);
+    unsigned int channel_id, filter, max_len = 0;
+    if (argc != 5 && argc != 6) {
+        fprintf(stderr, "Usage: %s <file> <channel> <filter 0..3> <message> [max_len]\n", argv[0]);
         return 1;
     }
 
     channel_id = (unsigned int) strtoul(argv[2], NULL, 0);
-    censor_mode = (unsigned int) strtoul(argv[3], NULL, 0);
+    filter = (unsigned int) strtoul(argv[3], NULL, 0);
+    if (argc == 6)
+        max_len = (unsigned int) strtoul(argv[5], NULL, 0);
     const char *msg = argv[4];
     const size_t len = strlen(msg);
     int fd = open(argv[1], O_RDWR);
@@ -23,8 +25,15 @@ int main(int argc, char *argv[]) {
         perror("an error occurred during open");
         return 1;
     }
-    if (ioctl(fd, MSG_SLOT_SET_CEN, censor_mode)) { // set censorship mode to the value specified in args
-        perror("an error occurred during ioctl (when SET_CEN)");
+    // optional: raise/lower the slot's message size limit before writing
+    if (max_len && ioctl(fd, MSG_SLOT_SET_MAXLEN, max_len)) {
+        perror("an error occurred during ioctl (when SET_MAXLEN)");
+        close(fd);
+        return 1;
+    }
+    // 0/1 go through the original censorship ioctl, the other filters (MSG_FILTER_*) are selected by id
+    if (filter <= 1 ? ioctl(fd, MSG_SLOT_SET_CEN, filter) : ioctl(fd, MSG_SLOT_SET_FILTER, filter)) {
+        perror("an error occurred during ioctl (when setting the filter)");
         close(fd);
         return 1;
     }
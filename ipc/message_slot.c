@@ -1,57 +1,171 @@
+#ifdef __KERNEL__
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/string.h>
 #include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/err.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
 #include <linux/init.h>
 #include <linux/types.h>
+#else
+#include "kshim.h" // user-space build (libmessage_slot.a), see message_slot_user.h
+#endif
 #include "message_slot.h"
 
+// Message buffers come from power-of-two kmem_caches (32 bytes .. MESSAGE_MAX_LEN_LIMIT).
+// A slot uses the smallest class that fits its configured max length.
+#define MSG_CACHE_MIN_SHIFT 5
+#define MSG_CACHE_CLASSES 10
+
+// How often the idle-channel sweep runs while some slot has an idle timeout
+#define EVICT_PERIOD HZ
+
+// Channels listed in debugfs <minor>/top
+#define TOP_N 10
+
 
 // ------------driver data structures-----------------------
 // represents one specific communication channel in the message slot device
 struct channel_node {
     unsigned long id;
-    char msg[MESSAGE_MAX_LEN];
+    char *msg; // message storage, allocated from msg_caches[msg_class] on the first write (NULL while empty)
+    int msg_class;
     size_t len;
+    unsigned long last_used; // jiffies of the last read/write, for idle eviction
+    unsigned int refs; // file descriptors currently bound to this channel. never freed while non-zero
+    int dead; // unlinked from its slot (deleted/evicted), freed by the last fd that drops it
+    u64 writes, reads, bytes_written, bytes_read; // updated under the slot lock that the data path holds anyway
     struct channel_node *next; // points to the next channel in the linked list (handles multiple channels per slot)
 };
 
+// Hot-path counters of a slot, one copy per CPU so reads/writes never share a cache line. Summed when reported
+struct slot_stats {
+    u64 writes, reads;
+    u64 bytes_written, bytes_read;
+    u64 misses; // reads that returned -EWOULDBLOCK
+    u64 write_errors, read_errors; // any other failure
+};
+
 // Each slot corresponds to a unique /dev/message_slotX device file (one per minor). Inside that device there are multiple channels.
 struct slot_node {
     int minor;
+    size_t max_len; // largest message a write may store, set with MSG_SLOT_SET_MAXLEN
+    int msg_class; // msg_caches index whose objects fit max_len
+    struct mutex lock; // protects the channel list and the message buffers hanging off it
     struct channel_node *channels;
+    unsigned int nr_channels;
+    size_t bytes; // sum of stored message lengths
+    unsigned int max_channels; // 0 == unlimited
+    size_t max_bytes; // 0 == unlimited
+    unsigned long idle_timeout; // in jiffies, 0 == channels are only removed by MSG_SLOT_DEL_CHANNEL
+    u64 created, deleted, evicted; // channel lifetime events, under lock
+    struct slot_stats __percpu *stats;
+    struct dentry *debug_dir; // debugfs message_slot/<minor>/
     struct slot_node *next;
 };
 
-// Each open file can independently select its target channel and censorship behavior.
+// Each open file can independently select its target channel and write filter.
 struct fd_private {
     unsigned long channel_id;
     //Which channel this file descriptor is using. set with IOCTL before read/write (0 == unset)
-    int censor; // 0/1
+    unsigned int filter; // index into filters[], MSG_FILTER_NONE by default
+    struct slot_node *slot; // slots live until module unload, so this is resolved once at open
+    struct channel_node *channel; // channel_id's node once it exists. holds a reference (channel->refs)
 };
 
 // A global linked list head for all allocated (active) slot_nodes (all device minors in use)
 static struct slot_node *slots_head = NULL;
+static DEFINE_MUTEX(slots_lock);
+
+// Created on first use, so only the size classes that some slot is configured for exist
+static struct kmem_cache *msg_caches[MSG_CACHE_CLASSES];
+static char *msg_cache_names[MSG_CACHE_CLASSES];
+static DEFINE_MUTEX(caches_lock);
+
+static void evict_idle_channels(struct work_struct *work);
+static DECLARE_DELAYED_WORK(evict_work, evict_idle_channels);
+
+static struct dentry *debug_root; // debugfs message_slot/
+static struct kobject *summary_kobj; // sysfs /sys/kernel/message_slot/
+static void slot_debugfs_create(struct slot_node *slot);
 
 // ------------------- helper functions -----------------------
+// smallest cache class whose objects can hold len bytes
+static int msg_class_for(size_t len) {
+    int class = 0;
+    while (class < MSG_CACHE_CLASSES - 1 && ((size_t)1 << (MSG_CACHE_MIN_SHIFT + class)) < len)
+        class++;
+    return class;
+}
+
+static struct kmem_cache *msg_cache_get(int class) {
+    size_t size = (size_t)1 << (MSG_CACHE_MIN_SHIFT + class);
+    struct kmem_cache *cache;
+    mutex_lock(&caches_lock);
+    cache = msg_caches[class];
+    if (!cache) {
+        msg_cache_names[class] = kasprintf(GFP_KERNEL, "message_slot_%zu", size);
+        if (msg_cache_names[class]) {
+            // the whole object is copied to/from user space, so whitelist it for hardened usercopy
+            cache = kmem_cache_create_usercopy(msg_cache_names[class], size, 0, 0, 0, size, NULL);
+            if (!cache) {
+                kfree(msg_cache_names[class]);
+                msg_cache_names[class] = NULL;
+            }
+            msg_caches[class] = cache;
+        }
+    }
+    mutex_unlock(&caches_lock);
+    return cache;
+}
+
 // Traverse the global list -If minor is found, return that slot. Otherwise create a new slot_node, set minor, and push it to the head of the list
 static struct slot_node *slot_get(int minor) {
     struct slot_node *s;
+    mutex_lock(&slots_lock);
     for (s = slots_head; s; s = s->next)
         if (s->minor == minor)
-            return s;
+            goto out;
     // slot doesnt exist, create new
     s = kmalloc(sizeof(*s), GFP_KERNEL);
     if (!s)
-        return NULL;
+        goto out;
+    s->stats = alloc_percpu(struct slot_stats); // zeroed
+    if (!s->stats) {
+        kfree(s);
+        s = NULL;
+        goto out;
+    }
     s->minor = minor;
+    s->max_len = MESSAGE_MAX_LEN;
+    s->msg_class = msg_class_for(MESSAGE_MAX_LEN);
+    mutex_init(&s->lock);
     s->channels = NULL;
+    s->nr_channels = 0;
+    s->bytes = 0;
+    s->max_channels = 0;
+    s->max_bytes = 0;
+    s->idle_timeout = 0;
+    s->created = s->deleted = s->evicted = 0;
+    slot_debugfs_create(s);
     s->next = slots_head;
     slots_head = s;
+out:
+    mutex_unlock(&slots_lock);
     return s;
 }
 
+// expects slot->lock held. NULL if the channel doesn't exist and create == 0, ERR_PTR if it couldn't be created
 static struct channel_node *channel_get(struct slot_node *slot, unsigned long id, int create) {
     struct channel_node *c;
     for (c = slot->channels; c; c = c->next)
@@ -59,134 +173,617 @@ static struct channel_node *channel_get(struct slot_node *slot, unsigned long id
             return c;
     if (!create)
         return NULL;
+    if (slot->max_channels && slot->nr_channels >= slot->max_channels)
+        return ERR_PTR(-EDQUOT);
     c = kmalloc(sizeof(*c), GFP_KERNEL); // Allocate new channel_node
     if (!c)
-        return NULL;
+        return ERR_PTR(-ENOMEM);
     c->id = id;
+    c->msg = NULL; // storage is only allocated once a message arrives
     c->len = 0; // no message yet
+    c->last_used = jiffies;
+    c->refs = 0;
+    c->dead = 0;
+    c->writes = c->reads = c->bytes_written = c->bytes_read = 0;
     c->next = slot->channels; // insert at head
     slot->channels = c;
+    slot->nr_channels++;
+    slot->created++;
+    return c;
+}
+
+static void channel_free_msg(struct channel_node *c) {
+    if (c->msg)
+        kmem_cache_free(msg_caches[c->msg_class], c->msg);
+    c->msg = NULL;
+    c->len = 0;
+}
+
+// expects slot->lock held. removes *link from the slot, the node itself stays around while an fd holds it
+static void channel_unlink(struct slot_node *slot, struct channel_node **link) {
+    struct channel_node *c = *link;
+    *link = c->next;
+    slot->nr_channels--;
+    slot->bytes -= c->len;
+    channel_free_msg(c);
+    if (c->refs)
+        c->dead = 1;
+    else
+        kfree(c);
+}
+
+// expects slot->lock held
+static void channel_put(struct channel_node *c) {
+    if (--c->refs == 0 && c->dead)
+        kfree(c);
+}
+
+// expects slot->lock held. Returns the channel this fd works on, binding it to the fd on first use so it can't be
+// freed underneath. A binding to a deleted/evicted channel is dropped and the id is looked up again.
+static struct channel_node *fd_channel(struct fd_private *fd_private_data, int create) {
+    struct channel_node *c = fd_private_data->channel;
+    if (c && c->dead) {
+        channel_put(c);
+        c = fd_private_data->channel = NULL;
+    }
+    if (!c) {
+        c = channel_get(fd_private_data->slot, fd_private_data->channel_id, create);
+        if (IS_ERR_OR_NULL(c))
+            return c;
+        c->refs++;
+        fd_private_data->channel = c;
+    }
     return c;
 }
 
+static void fd_channel_unbind(struct fd_private *fd_private_data) {
+    struct slot_node *slot = fd_private_data->slot;
+    mutex_lock(&slot->lock);
+    if (fd_private_data->channel)
+        channel_put(fd_private_data->channel);
+    fd_private_data->channel = NULL;
+    mutex_unlock(&slot->lock);
+}
+
+// Periodic sweep: unlinks channels nobody is bound to that weren't touched for their slot's idle_timeout.
+// Keeps rescheduling itself as long as at least one slot has a timeout configured.
+static void evict_idle_channels(struct work_struct *work) {
+    struct slot_node *s;
+    struct channel_node **link;
+    int rearm = 0;
+    mutex_lock(&slots_lock);
+    for (s = slots_head; s; s = s->next) {
+        mutex_lock(&s->lock);
+        if (s->idle_timeout) {
+            rearm = 1;
+            for (link = &s->channels; *link;) {
+                struct channel_node *c = *link;
+                if (c->refs == 0 && time_after(jiffies, c->last_used + s->idle_timeout)) {
+                    channel_unlink(s, link); // *link now points at the next channel
+                    s->evicted++;
+                } else
+                    link = &c->next;
+            }
+        }
+        mutex_unlock(&s->lock);
+    }
+    mutex_unlock(&slots_lock);
+    if (rearm)
+        schedule_delayed_work(&evict_work, EVICT_PERIOD);
+}
+
+// ------------------- statistics -----------------------
+// debugfs message_slot/<minor>/{stats,channels,top} per slot, and a summary over all slots in
+// /sys/kernel/message_slot/. Reporting walks the channel list under the slot lock, the data path only bumps counters.
+static void slot_stats_sum(struct slot_node *slot, struct slot_stats *sum) {
+    int cpu;
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        struct slot_stats *st = per_cpu_ptr(slot->stats, cpu);
+        sum->writes += st->writes;
+        sum->reads += st->reads;
+        sum->bytes_written += st->bytes_written;
+        sum->bytes_read += st->bytes_read;
+        sum->misses += st->misses;
+        sum->write_errors += st->write_errors;
+        sum->read_errors += st->read_errors;
+    }
+}
+
+static int stats_show(struct seq_file *m, void *v) {
+    struct slot_node *slot = m->private;
+    struct slot_stats sum;
+    slot_stats_sum(slot, &sum);
+    seq_printf(m, "writes %llu\nreads %llu\nbytes_written %llu\nbytes_read %llu\nmisses %llu\n"
+               "write_errors %llu\nread_errors %llu\n",
+               (unsigned long long)sum.writes, (unsigned long long)sum.reads,
+               (unsigned long long)sum.bytes_written, (unsigned long long)sum.bytes_read,
+               (unsigned long long)sum.misses, (unsigned long long)sum.write_errors,
+               (unsigned long long)sum.read_errors);
+    mutex_lock(&slot->lock);
+    seq_printf(m, "channels %u\nbytes %zu\nmax_len %zu\nmax_channels %u\nmax_bytes %zu\n"
+               "created %llu\ndeleted %llu\nevicted %llu\n",
+               slot->nr_channels, slot->bytes, slot->max_len, slot->max_channels, slot->max_bytes,
+               (unsigned long long)slot->created, (unsigned long long)slot->deleted,
+               (unsigned long long)slot->evicted);
+    mutex_unlock(&slot->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
+static void channel_show(struct seq_file *m, const struct channel_node *c) {
+    seq_printf(m, "%lu %zu %u %llu %llu %llu %llu\n", c->id, c->len, c->refs, (unsigned long long)c->writes,
+               (unsigned long long)c->reads, (unsigned long long)c->bytes_written, (unsigned long long)c->bytes_read);
+}
+
+#define CHANNEL_HEADER "# id len fds writes reads bytes_written bytes_read\n"
+
+static int channels_show(struct seq_file *m, void *v) {
+    struct slot_node *slot = m->private;
+    struct channel_node *c;
+    seq_puts(m, CHANNEL_HEADER);
+    mutex_lock(&slot->lock);
+    for (c = slot->channels; c; c = c->next)
+        channel_show(m, c);
+    mutex_unlock(&slot->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(channels);
+
+// the TOP_N channels with the most reads + writes, busiest first
+static int top_show(struct seq_file *m, void *v) {
+    struct slot_node *slot = m->private;
+    struct channel_node *c, *top[TOP_N];
+    int n = 0, i;
+    seq_puts(m, CHANNEL_HEADER);
+    mutex_lock(&slot->lock);
+    for (c = slot->channels; c; c = c->next) {
+        u64 ops = c->writes + c->reads;
+        if (n == TOP_N && ops <= top[n - 1]->writes + top[n - 1]->reads)
+            continue;
+        if (n < TOP_N)
+            n++;
+        // insertion into the sorted array, dropping the last entry when it is full
+        for (i = n - 1; i > 0 && top[i - 1]->writes + top[i - 1]->reads < ops; i--)
+            top[i] = top[i - 1];
+        top[i] = c;
+    }
+    for (i = 0; i < n; i++)
+        channel_show(m, top[i]);
+    mutex_unlock(&slot->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(top);
+
+// debugfs failures are not fatal (and by convention not checked), the files just won't be there
+static void slot_debugfs_create(struct slot_node *slot) {
+    char name[16];
+    snprintf(name, sizeof(name), "%d", slot->minor);
+    slot->debug_dir = debugfs_create_dir(name, debug_root);
+    debugfs_create_file("stats", 0444, slot->debug_dir, slot, &stats_fops);
+    debugfs_create_file("channels", 0444, slot->debug_dir, slot, &channels_fops);
+    debugfs_create_file("top", 0444, slot->debug_dir, slot, &top_fops);
+}
+
+struct summary {
+    u64 slots, channels, bytes, writes, reads, misses;
+};
+
+static void summary_collect(struct summary *sum) {
+    struct slot_node *s;
+    struct slot_stats st;
+    memset(sum, 0, sizeof(*sum));
+    mutex_lock(&slots_lock);
+    for (s = slots_head; s; s = s->next) {
+        slot_stats_sum(s, &st);
+        sum->slots++;
+        sum->writes += st.writes;
+        sum->reads += st.reads;
+        sum->misses += st.misses;
+        mutex_lock(&s->lock);
+        sum->channels += s->nr_channels;
+        sum->bytes += s->bytes;
+        mutex_unlock(&s->lock);
+    }
+    mutex_unlock(&slots_lock);
+}
+
+// one read-only sysfs attribute per summary field
+#define SUMMARY_ATTR(field) \
+    static ssize_t summary_##field##_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) { \
+        struct summary sum; \
+        summary_collect(&sum); \
+        return sysfs_emit(buf, "%llu\n", (unsigned long long)sum.field); \
+    } \
+    static struct kobj_attribute field##_attr = __ATTR(field, 0444, summary_##field##_show, NULL)
+
+SUMMARY_ATTR(slots);
+SUMMARY_ATTR(channels);
+SUMMARY_ATTR(bytes);
+SUMMARY_ATTR(writes);
+SUMMARY_ATTR(reads);
+SUMMARY_ATTR(misses);
+
+static struct attribute *summary_attrs[] = {
+    &slots_attr.attr, &channels_attr.attr, &bytes_attr.attr,
+    &writes_attr.attr, &reads_attr.attr, &misses_attr.attr, NULL,
+};
+
+static const struct attribute_group summary_group = {
+    .attrs = summary_attrs,
+};
+
+// ------------------- write filters -----------------------
+// Filters rewrite a message in place after it was copied in. The built-in ones work a machine word at a time
+// (SWAR) so large messages are rewritten at close to memory bandwidth, with a byte loop only for the tail.
+// Adding a rule means adding an apply function and a filters[] entry (plus an MSG_FILTER_* id in the header).
+#define WORD_BYTES sizeof(unsigned long)
+#define ONES (~0UL / 255) // 0x0101...01
+#define HIGHS (ONES * 0x80) // 0x8080...80
+
+// every-3rd-byte pattern of the censor filter. It repeats every 3 words, since a word is never a multiple of 3 bytes
+static unsigned long censor_mask[3], censor_fill[3];
+
+static inline unsigned long load_word(const char *p) {
+    unsigned long w;
+    memcpy(&w, p, WORD_BYTES); // compiles to a plain load, without alignment or aliasing assumptions
+    return w;
+}
+
+static inline void store_word(char *p, unsigned long w) {
+    memcpy(p, &w, WORD_BYTES);
+}
+
+// 0x80 in every byte of x that is strictly between lo and hi (both <= 128). Exact, no false positives
+static inline unsigned long bytes_between(unsigned long x, unsigned char lo, unsigned char hi) {
+    unsigned long low7 = x & (ONES * 0x7f);
+    return (ONES * (0x7f + hi) - low7) & ~x & (low7 + ONES * (0x7f - lo)) & HIGHS;
+}
+
+// expands 0x80 byte flags into 0xff byte masks
+static inline unsigned long flags_to_mask(unsigned long flags) {
+    return (flags >> 7) * 0xff;
+}
+
+static void filter_init(void) {
+    char mask[3 * WORD_BYTES], fill[3 * WORD_BYTES];
+    size_t i;
+    for (i = 0; i < sizeof(mask); i++) {
+        mask[i] = i % 3 == 2 ? (char)0xff : 0;
+        fill[i] = i % 3 == 2 ? '#' : 0;
+    }
+    for (i = 0; i < 3; i++) {
+        censor_mask[i] = load_word(mask + i * WORD_BYTES);
+        censor_fill[i] = load_word(fill + i * WORD_BYTES);
+    }
+}
+
+// Censorship - replace every 3rd character with '#'
+static void filter_censor(char *buf, size_t len) {
+    size_t i, j;
+    for (i = 0; i + 3 * WORD_BYTES <= len; i += 3 * WORD_BYTES)
+        for (j = 0; j < 3; j++) {
+            char *p = buf + i + j * WORD_BYTES;
+            store_word(p, (load_word(p) & ~censor_mask[j]) | censor_fill[j]);
+        }
+    for (i += 2; i < len; i += 3) // i was a multiple of 3, so the pattern continues at i + 2
+        buf[i] = '#';
+}
+
+static void filter_mask_digits(char *buf, size_t len) {
+    size_t i;
+    for (i = 0; i + WORD_BYTES <= len; i += WORD_BYTES) {
+        unsigned long w = load_word(buf + i);
+        unsigned long mask = flags_to_mask(bytes_between(w, '0' - 1, '9' + 1));
+        if (mask)
+            store_word(buf + i, (w & ~mask) | (ONES * '*' & mask));
+    }
+    for (; i < len; i++)
+        if (buf[i] >= '0' && buf[i] <= '9')
+            buf[i] = '*';
+}
+
+static void filter_upper(char *buf, size_t len) {
+    size_t i;
+    for (i = 0; i + WORD_BYTES <= len; i += WORD_BYTES) {
+        unsigned long w = load_word(buf + i);
+        unsigned long flags = bytes_between(w, 'a' - 1, 'z' + 1);
+        if (flags)
+            store_word(buf + i, w ^ (flags >> 2)); // 0x80 >> 2 == 0x20, the ASCII case bit
+    }
+    for (; i < len; i++)
+        if (buf[i] >= 'a' && buf[i] <= 'z')
+            buf[i] ^= 0x20;
+}
+
+static const struct msg_filter {
+    const char *name;
+    void (*apply)(char *buf, size_t len); // NULL == leave the message as written
+} filters[] = {
+    [MSG_FILTER_NONE] = {"none", NULL},
+    [MSG_FILTER_CENSOR] = {"censor", filter_censor},
+    [MSG_FILTER_MASK_DIGITS] = {"mask_digits", filter_mask_digits},
+    [MSG_FILTER_UPPER] = {"upper", filter_upper},
+};
+
 // --------------- file operations --------------
 static int device_open(struct inode *inode, struct file *file) {
-    struct fd_private *fd_private_data; // for storing per-open-file data like channel and censor setting
-    if (!slot_get(iminor(inode)))
-        // ensure slot is created (searches for an existing slot_node. if not found it'll create)
+    struct fd_private *fd_private_data; // for storing per-open-file data like channel and filter setting
+    // ensure slot is created (searches for an existing slot_node. if not found it'll create)
+    struct slot_node *slot = slot_get(iminor(inode));
+    if (!slot)
         return -ENOMEM;
 
     fd_private_data = kmalloc(sizeof(*fd_private_data), GFP_KERNEL);
     if (!fd_private_data)
         return -ENOMEM;
     fd_private_data->channel_id = 0;
-    fd_private_data->censor = 0;
+    fd_private_data->filter = MSG_FILTER_NONE;
+    fd_private_data->slot = slot;
+    fd_private_data->channel = NULL;
     file->private_data = fd_private_data; // Attach this struct to the open file for later access
     return 0;
 }
 
 static int device_release(struct inode *inode, struct file *file) {
+    fd_channel_unbind(file->private_data); // the channel becomes evictable again
     kfree(file->private_data);
     return 0;
 }
 
 static long device_ioctl(struct file *file, unsigned int cmd, unsigned long ioctl_param) {
     struct fd_private *fd_private_data = file->private_data;
-    unsigned int arg_value;
-    if (cmd != MSG_SLOT_CHANNEL && cmd != MSG_SLOT_SET_CEN)
-        return -EINVAL;
-    arg_value = (unsigned int)ioctl_param;
-    if (cmd == MSG_SLOT_CHANNEL) {
+    struct slot_node *slot = fd_private_data->slot;
+    struct channel_node **link;
+    int found;
+    unsigned int arg_value = (unsigned int)ioctl_param;
+    switch (cmd) {
+    case MSG_SLOT_CHANNEL:
         if (arg_value == 0)
             return -EINVAL;
+        if (arg_value != fd_private_data->channel_id)
+            fd_channel_unbind(fd_private_data);
         fd_private_data->channel_id = arg_value;
-    } else {
-        // censorship command (MSG_SLOT_SET_CEN)
+        return 0;
+    case MSG_SLOT_SET_CEN:
         if (arg_value != 0 && arg_value != 1)
             return -EINVAL;
-        fd_private_data->censor = arg_value;
+        fd_private_data->filter = arg_value ? MSG_FILTER_CENSOR : MSG_FILTER_NONE;
+        return 0;
+    case MSG_SLOT_SET_FILTER:
+        if (arg_value >= ARRAY_SIZE(filters))
+            return -EINVAL;
+        fd_private_data->filter = arg_value;
+        return 0;
+    case MSG_SLOT_SET_MAXLEN:
+        // applies to the whole slot. stored messages keep their buffers until they are overwritten
+        if (arg_value == 0 || arg_value > MESSAGE_MAX_LEN_LIMIT)
+            return -EINVAL;
+        if (!msg_cache_get(msg_class_for(arg_value)))
+            return -ENOMEM;
+        mutex_lock(&slot->lock);
+        slot->max_len = arg_value;
+        slot->msg_class = msg_class_for(arg_value);
+        mutex_unlock(&slot->lock);
+        return 0;
+    case MSG_SLOT_DEL_CHANNEL:
+        if (arg_value == 0)
+            return -EINVAL;
+        mutex_lock(&slot->lock);
+        for (link = &slot->channels; *link && (*link)->id != arg_value; link = &(*link)->next) {}
+        found = *link != NULL;
+        if (found) {
+            channel_unlink(slot, link); // fds bound to it notice on their next read/write
+            slot->deleted++;
+        }
+        mutex_unlock(&slot->lock);
+        return found ? 0 : -ENOENT;
+    case MSG_SLOT_SET_IDLE_TIMEOUT:
+        mutex_lock(&slot->lock);
+        slot->idle_timeout = (unsigned long)arg_value * HZ;
+        mutex_unlock(&slot->lock);
+        if (arg_value)
+            schedule_delayed_work(&evict_work, EVICT_PERIOD); // no-op if the sweep is already pending
+        return 0;
+    case MSG_SLOT_SET_MAX_CHANNELS:
+        // lowering a limit below current usage only blocks new channels, nothing is evicted
+        mutex_lock(&slot->lock);
+        slot->max_channels = arg_value;
+        mutex_unlock(&slot->lock);
+        return 0;
+    case MSG_SLOT_SET_MAX_BYTES:
+        mutex_lock(&slot->lock);
+        slot->max_bytes = arg_value;
+        mutex_unlock(&slot->lock);
+        return 0;
+    default:
+        return -EINVAL;
     }
-    return 0;
 }
 
-static ssize_t device_write(struct file *file, const char __user *buf, size_t len, loff_t *off) {
-    struct fd_private *fd_private_data = file->private_data;
-    struct slot_node *slot;
+// the payload is copied straight from the user iovecs into its slab buffer instead of bouncing through a
+// fixed-size stack buffer
+static ssize_t slot_write(struct fd_private *fd_private_data, struct iov_iter *from) {
+    struct slot_node *slot = fd_private_data->slot;
     struct channel_node *channel;
-    char kernel_buf[MESSAGE_MAX_LEN];
-    size_t i;
+    size_t len = iov_iter_count(from);
+    struct kmem_cache *cache;
+    char *buf, *old_buf;
+    int class, old_class;
+    ssize_t ret;
     if (fd_private_data->channel_id == 0) // Error case 1: No channel has been set
         return -EINVAL;
-    if (len == 0 || len > MESSAGE_MAX_LEN) // Error case 2: Message length is 0 or greater than 128
+    mutex_lock(&slot->lock);
+    class = slot->msg_class;
+    if (len == 0 || len > slot->max_len) { // Error case 2: Message length is 0 or greater than the slot's max
+        mutex_unlock(&slot->lock);
         return -EMSGSIZE;
-    if (copy_from_user(kernel_buf, buf, len))
-        return -EFAULT;
-    if (fd_private_data->censor) // Censorship - replace every 3rd character with '#'
-        for (i = 2; i < len; i += 3)
-            kernel_buf[i] = '#';
+    }
+    mutex_unlock(&slot->lock);
 
-    slot = slot_get(iminor(file_inode(file)));
-    if (!slot) // Other error cases: Memory allocation
+    // Fill a fresh buffer first so a faulting copy never leaves a half-written message in the channel
+    cache = msg_cache_get(class);
+    if (!cache)
         return -ENOMEM;
-    channel = channel_get(slot, fd_private_data->channel_id, 1);
-    if (!channel) // Other error cases: Channel creation failure
+    buf = kmem_cache_alloc(cache, GFP_KERNEL);
+    if (!buf)
         return -ENOMEM;
-    memcpy(channel->msg, kernel_buf, len); // Save the message into the channel buffer
+    if (copy_from_iter(buf, len, from) != len) {
+        kmem_cache_free(cache, buf);
+        return -EFAULT;
+    }
+    if (filters[fd_private_data->filter].apply)
+        filters[fd_private_data->filter].apply(buf, len);
+
+    mutex_lock(&slot->lock);
+    channel = fd_channel(fd_private_data, 0);
+    // Error case 3: the slot's byte limit. checked before creating the channel so a rejected write leaves nothing behind
+    if (slot->max_bytes && slot->bytes - (channel ? channel->len : 0) + len > slot->max_bytes) {
+        ret = -EDQUOT;
+        goto out_free;
+    }
+    if (!channel)
+        channel = fd_channel(fd_private_data, 1);
+    if (IS_ERR(channel)) { // Other error cases: Channel limit / creation failure
+        ret = PTR_ERR(channel);
+        goto out_free;
+    }
+    old_buf = channel->msg; // Swap the new message in, the previous one is released outside the lock
+    old_class = channel->msg_class;
+    slot->bytes = slot->bytes - channel->len + len;
+    channel->msg = buf;
+    channel->msg_class = class;
     channel->len = len;
+    channel->last_used = jiffies;
+    channel->writes++;
+    channel->bytes_written += len;
+    mutex_unlock(&slot->lock);
+    if (old_buf)
+        kmem_cache_free(msg_caches[old_class], old_buf);
     return len;
+
+out_free:
+    mutex_unlock(&slot->lock);
+    kmem_cache_free(cache, buf);
+    return ret;
 }
 
-static ssize_t device_read(struct file *file, char __user *buf, size_t len, loff_t *off) {
-    struct fd_private *fd_private_data = file->private_data;
-    struct slot_node *slot;
+static ssize_t slot_read(struct fd_private *fd_private_data, struct iov_iter *to) {
+    struct slot_node *slot = fd_private_data->slot;
     struct channel_node *channel;
+    ssize_t ret;
     if (fd_private_data->channel_id == 0) // Err #1: No channel has been set
         return -EINVAL;
-    slot = slot_get(iminor(file_inode(file)));
-    if (!slot) // Err #2: No slot exists for this minor
-        return -EWOULDBLOCK;
-    channel = channel_get(slot, fd_private_data->channel_id, 0);
+    mutex_lock(&slot->lock);
+    channel = fd_channel(fd_private_data, 0);
+    if (channel)
+        channel->last_used = jiffies;
     if (!channel || channel->len == 0) // Err #2: No channel / no message has been written
-        return -EWOULDBLOCK;
-    if (len < channel->len) // Err #3: check user buffer is big enough
-        return -ENOSPC;
-    if (copy_to_user(buf, channel->msg, channel->len)) // copies the message to user buffer
-        return -EFAULT;
-    return channel->len;
+        ret = -EWOULDBLOCK;
+    else if (iov_iter_count(to) < channel->len) // Err #3: check user buffer is big enough
+        ret = -ENOSPC;
+    else if (copy_to_iter(channel->msg, channel->len, to) != channel->len) // copies the message to user buffer
+        ret = -EFAULT;
+    else {
+        ret = channel->len;
+        channel->reads++;
+        channel->bytes_read += ret;
+    }
+    mutex_unlock(&slot->lock);
+    return ret;
+}
+
+// write_iter/read_iter instead of write/read: write() and writev() (read()/readv()) all land here
+static ssize_t device_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    struct fd_private *fd_private_data = iocb->ki_filp->private_data;
+    struct slot_stats __percpu *stats = fd_private_data->slot->stats;
+    ssize_t ret = slot_write(fd_private_data, from);
+    if (ret < 0) {
+        this_cpu_inc(stats->write_errors);
+    } else {
+        this_cpu_inc(stats->writes);
+        this_cpu_add(stats->bytes_written, ret);
+    }
+    return ret;
+}
+
+static ssize_t device_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    struct fd_private *fd_private_data = iocb->ki_filp->private_data;
+    struct slot_stats __percpu *stats = fd_private_data->slot->stats;
+    ssize_t ret = slot_read(fd_private_data, to);
+    if (ret == -EWOULDBLOCK) {
+        this_cpu_inc(stats->misses);
+    } else if (ret < 0) {
+        this_cpu_inc(stats->read_errors);
+    } else {
+        this_cpu_inc(stats->reads);
+        this_cpu_add(stats->bytes_read, ret);
+    }
+    return ret;
 }
 
 static struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = device_open,
     .release = device_release, // Frees private data. not required, added to avoid memory leak
-    .read = device_read,
-    .write = device_write,
+    .read_iter = device_read_iter,
+    .write_iter = device_write_iter,
     .unlocked_ioctl = device_ioctl,
 };
 
 // ---------- module init / exit ----------
 static int __init message_slot_init(void) {
-    int rc = register_chrdev(MAJOR_NUM, DEVICE_NAME, &fops);
-    if (rc < 0)
+    int rc;
+    filter_init();
+    debug_root = debugfs_create_dir(DEVICE_NAME, NULL);
+    summary_kobj = kobject_create_and_add(DEVICE_NAME, kernel_kobj);
+    if (!summary_kobj) {
+        rc = -ENOMEM;
+        goto err_debugfs;
+    }
+    rc = sysfs_create_group(summary_kobj, &summary_group);
+    if (rc)
+        goto err_kobj;
+    rc = register_chrdev(MAJOR_NUM, DEVICE_NAME, &fops);
+    if (rc < 0) {
         printk(KERN_ERR "message_slot: failed registering\n");
+        goto err_kobj;
+    }
+    return rc;
+
+err_kobj:
+    kobject_put(summary_kobj); // also removes the attribute group
+err_debugfs:
+    debugfs_remove_recursive(debug_root);
     return rc;
 }
 
 static void __exit message_slot_exit(void) {
     struct slot_node *s, *s_tmp;
     struct channel_node *c;
+    int class;
     unregister_chrdev(MAJOR_NUM, DEVICE_NAME);
+    cancel_delayed_work_sync(&evict_work); // also stops a sweep that is re-arming itself
+    // stats files go first, their show functions walk the slots freed below
+    kobject_put(summary_kobj);
+    debugfs_remove_recursive(debug_root);
     // free all allocated memory
     for (s = slots_head; s;) {
         for (c = s->channels; c;) {
             struct channel_node *c_tmp = c->next;
+            channel_free_msg(c);
             kfree(c);
             c = c_tmp;
         }
         s_tmp = s->next;
+        free_percpu(s->stats);
         kfree(s);
         s = s_tmp;
     }
+    for (class = 0; class < MSG_CACHE_CLASSES; class++) {
+        kmem_cache_destroy(msg_caches[class]); // NULL-safe
+        kfree(msg_cache_names[class]);
+    }
 }
 MODULE_LICENSE("GPL");
 
@@ -5,8 +5,24 @@
 
 #define MSG_SLOT_CHANNEL _IOW('M', 1, unsigned int)
 #define MSG_SLOT_SET_CEN _IOW('M', 2, unsigned int)
+// Sets the largest message accepted by every channel of this slot (1..MESSAGE_MAX_LEN_LIMIT)
+#define MSG_SLOT_SET_MAXLEN _IOW('M', 3, unsigned int)
+// Channel reclamation and per-slot memory limits (all of them apply to the whole slot)
+#define MSG_SLOT_DEL_CHANNEL _IOW('M', 4, unsigned int) // drop a channel and its message. -ENOENT if unknown
+#define MSG_SLOT_SET_IDLE_TIMEOUT _IOW('M', 5, unsigned int) // evict channels idle for this many seconds (0 == never)
+#define MSG_SLOT_SET_MAX_CHANNELS _IOW('M', 6, unsigned int) // creating more channels fails with -EDQUOT (0 == unlimited)
+#define MSG_SLOT_SET_MAX_BYTES _IOW('M', 7, unsigned int) // stored message bytes above this fail with -EDQUOT (0 == unlimited)
+// Selects the transform applied to messages written through this fd. MSG_SLOT_SET_CEN 1/0 is the same as
+// MSG_FILTER_CENSOR/MSG_FILTER_NONE
+#define MSG_SLOT_SET_FILTER _IOW('M', 8, unsigned int)
 
-#define MESSAGE_MAX_LEN 128
+#define MSG_FILTER_NONE 0
+#define MSG_FILTER_CENSOR 1 // every 3rd byte becomes '#'
+#define MSG_FILTER_MASK_DIGITS 2 // ASCII digits become '*'
+#define MSG_FILTER_UPPER 3 // ASCII lowercase letters become uppercase
+
+#define MESSAGE_MAX_LEN 128 // default per-slot limit until MSG_SLOT_SET_MAXLEN changes it
+#define MESSAGE_MAX_LEN_LIMIT (16 * 1024) // upper bound for MSG_SLOT_SET_MAXLEN (4 pages)
 #define DEVICE_NAME "message_slot"
 #define MAJOR_NUM 235
 
@@ -0,0 +1,290 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "message_slot_user.h"
+
+// Multi-threaded load generator for the message slot logic. For every (channel count, message size) pair it runs
+// a fixed-duration mix of writes and reads from N threads on random channels and reports messages/sec and latency
+// percentiles. By default it drives libmessage_slot.a in-process (no root, no module). With -D it runs the same
+// workload against a real device file of the loaded module instead. -S dumps the driver's own statistics for the
+// slot after every run (library only, the module has them under /sys/kernel/debug/message_slot/).
+
+#define MAX_LIST 16
+#define MAX_SAMPLES (1 << 20) // latency samples kept per thread (reservoir sampled beyond that)
+
+// ---------- backends ----------
+// lib: msl_* calls. dev: syscalls on the device file. Both return -errno on failure like the driver
+static const char *device_path;
+static int show_stats;
+
+static void *lib_open(unsigned int minor) { return msl_open(minor); }
+static long lib_ioctl(void *f, unsigned int cmd, unsigned long arg) { return msl_ioctl(f, cmd, arg); }
+static ssize_t lib_write(void *f, const void *buf, size_t len) { return msl_write(f, buf, len); }
+static ssize_t lib_read(void *f, void *buf, size_t len) { return msl_read(f, buf, len); }
+static void lib_close(void *f) { msl_close(f); }
+
+static void *dev_open(unsigned int minor) {
+    int fd = open(device_path, O_RDWR);
+    (void)minor; // the device file decides the minor
+    return fd < 0 ? NULL : (void *)(intptr_t)(fd + 1); // +1 keeps fd 0 distinct from NULL
+}
+static long dev_ioctl(void *f, unsigned int cmd, unsigned long arg) {
+    return ioctl((int)(intptr_t)f - 1, cmd, arg) ? -errno : 0;
+}
+static ssize_t dev_write(void *f, const void *buf, size_t len) {
+    ssize_t n = write((int)(intptr_t)f - 1, buf, len);
+    return n < 0 ? -errno : n;
+}
+static ssize_t dev_read(void *f, void *buf, size_t len) {
+    ssize_t n = read((int)(intptr_t)f - 1, buf, len);
+    return n < 0 ? -errno : n;
+}
+static void dev_close(void *f) { close((int)(intptr_t)f - 1); }
+
+static struct backend {
+    void *(*open)(unsigned int minor);
+    long (*ioctl)(void *f, unsigned int cmd, unsigned long arg);
+    ssize_t (*write)(void *f, const void *buf, size_t len);
+    ssize_t (*read)(void *f, void *buf, size_t len);
+    void (*close)(void *f);
+} lib_backend = {lib_open, lib_ioctl, lib_write, lib_read, lib_close},
+  dev_backend = {dev_open, dev_ioctl, dev_write, dev_read, dev_close}, *be = &lib_backend;
+
+// ---------- workload ----------
+struct run {
+    unsigned int minor;
+    unsigned long first_channel; // channel ids first_channel .. first_channel + channels - 1
+    unsigned int channels;
+    size_t size;
+    int write_pct;
+    atomic_int stop;
+    pthread_barrier_t start;
+};
+
+struct worker {
+    pthread_t thread;
+    struct run *run;
+    uint64_t seed;
+    uint64_t ops, misses, errors;
+    uint64_t *samples; // op latency in ns
+    size_t nsamples;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    struct run *r = w->run;
+    char *buf = malloc(MESSAGE_MAX_LEN_LIMIT); // reads must fit any message on the slot
+    void *f = be->open(r->minor);
+    if (!buf || !f) {
+        perror("worker setup");
+        exit(1);
+    }
+    memset(buf, 'm', r->size);
+    pthread_barrier_wait(&r->start);
+    while (!atomic_load_explicit(&r->stop, memory_order_relaxed)) {
+        uint64_t rnd = xorshift(&w->seed), t0, dt;
+        ssize_t n;
+        if (be->ioctl(f, MSG_SLOT_CHANNEL, r->first_channel + rnd % r->channels)) {
+            w->errors++;
+            continue;
+        }
+        t0 = now_ns();
+        if ((int)((rnd >> 32) % 100) < r->write_pct)
+            n = be->write(f, buf, r->size);
+        else
+            n = be->read(f, buf, MESSAGE_MAX_LEN_LIMIT);
+        dt = now_ns() - t0;
+        w->ops++;
+        if (n == -EWOULDBLOCK)
+            w->misses++;
+        else if (n < 0)
+            w->errors++;
+        if (w->nsamples < MAX_SAMPLES)
+            w->samples[w->nsamples++] = dt;
+        else if ((rnd = xorshift(&w->seed) % w->ops) < MAX_SAMPLES) // reservoir: every op equally likely to be kept
+            w->samples[rnd] = dt;
+    }
+    be->close(f);
+    free(buf);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+    return n ? sorted[(size_t)(p / 100.0 * (double)(n - 1))] : 0;
+}
+
+static void run_one(struct run *r, int nthreads, double seconds) {
+    struct worker *workers = calloc(nthreads, sizeof(*workers));
+    uint64_t ops = 0, misses = 0, errors = 0, t0, elapsed, *all;
+    size_t nall = 0, i;
+    void *f;
+    char *msg = malloc(r->size);
+    int t;
+
+    // configure the slot and put a message in every channel so reads hit
+    f = be->open(r->minor);
+    if (!f || !workers || !msg) {
+        perror("setup");
+        exit(1);
+    }
+    if (r->size > MESSAGE_MAX_LEN && be->ioctl(f, MSG_SLOT_SET_MAXLEN, r->size)) {
+        fprintf(stderr, "cannot raise the slot limit to %zu bytes\n", r->size);
+        exit(1);
+    }
+    memset(msg, 'p', r->size);
+    for (i = 0; i < r->channels; i++)
+        if (be->ioctl(f, MSG_SLOT_CHANNEL, r->first_channel + i) || be->write(f, msg, r->size) < 0) {
+            fprintf(stderr, "cannot prefill channel %lu\n", r->first_channel + i);
+            exit(1);
+        }
+    be->close(f);
+    free(msg);
+
+    atomic_store(&r->stop, 0);
+    pthread_barrier_init(&r->start, NULL, nthreads + 1);
+    for (t = 0; t < nthreads; t++) {
+        workers[t].run = r;
+        workers[t].seed = 0x9e3779b97f4a7c15ull * (t + 1);
+        workers[t].samples = malloc(MAX_SAMPLES * sizeof(uint64_t));
+        if (!workers[t].samples || pthread_create(&workers[t].thread, NULL, worker_main, &workers[t])) {
+            perror("worker");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&r->start);
+    t0 = now_ns();
+    usleep((useconds_t)(seconds * 1e6));
+    atomic_store(&r->stop, 1);
+    for (t = 0; t < nthreads; t++)
+        pthread_join(workers[t].thread, NULL);
+    elapsed = now_ns() - t0;
+    pthread_barrier_destroy(&r->start);
+
+    for (t = 0; t < nthreads; t++)
+        nall += workers[t].nsamples;
+    all = malloc((nall ? nall : 1) * sizeof(uint64_t));
+    nall = 0;
+    for (t = 0; t < nthreads; t++) {
+        memcpy(all + nall, workers[t].samples, workers[t].nsamples * sizeof(uint64_t));
+        nall += workers[t].nsamples;
+        ops += workers[t].ops;
+        misses += workers[t].misses;
+        errors += workers[t].errors;
+        free(workers[t].samples);
+    }
+    qsort(all, nall, sizeof(uint64_t), cmp_u64);
+    printf("%9u %7zu %7d %12.0f %9.1f %8lu %8lu %8lu %8lu %9lu %7lu %6lu\n", r->channels, r->size, nthreads,
+           ops * 1e9 / elapsed, ops * (double)r->size * 1e9 / elapsed / (1 << 20),
+           (unsigned long)percentile(all, nall, 50), (unsigned long)percentile(all, nall, 90),
+           (unsigned long)percentile(all, nall, 99), (unsigned long)percentile(all, nall, 99.9),
+           (unsigned long)(nall ? all[nall - 1] : 0), (unsigned long)misses, (unsigned long)errors);
+    if (show_stats && be == &lib_backend) {
+        static char text[1 << 16];
+        char path[64];
+        snprintf(path, sizeof(path), "message_slot/%u/stats", r->minor);
+        if (msl_debugfs_read(path, text, sizeof(text)) > 0)
+            printf("%s", text);
+        snprintf(path, sizeof(path), "message_slot/%u/top", r->minor);
+        if (msl_debugfs_read(path, text, sizeof(text)) > 0)
+            printf("%s", text);
+    }
+    fflush(stdout);
+    free(all);
+    free(workers);
+}
+
+// "1,64,4096" -> list. returns the number of entries
+static int parse_list(const char *arg, unsigned long *out) {
+    int n = 0;
+    char *end;
+    while (*arg && n < MAX_LIST) {
+        out[n++] = strtoul(arg, &end, 0);
+        if (end == arg || (*end && *end != ','))
+            return -1;
+        arg = *end ? end + 1 : end;
+    }
+    return n;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-t threads] [-c channels,...] [-s sizes,...] [-d seconds] [-w write%%] [-D device] [-S]\n"
+            "  defaults: -t 4 -c 1,64,4096 -s 16,128,4096 -d 1 -w 50, in-process library unless -D is given\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long channels[MAX_LIST] = {1, 64, 4096}, sizes[MAX_LIST] = {16, 128, 4096};
+    int nchannels = 3, nsizes = 3, nthreads = 4, write_pct = 50, opt, i, j;
+    double seconds = 1;
+    unsigned int minor = 0;
+    unsigned long next_channel = 1;
+
+    while ((opt = getopt(argc, argv, "t:c:s:d:w:D:S")) != -1) {
+        switch (opt) {
+        case 't': nthreads = atoi(optarg); break;
+        case 'c': nchannels = parse_list(optarg, channels); break;
+        case 's': nsizes = parse_list(optarg, sizes); break;
+        case 'd': seconds = atof(optarg); break;
+        case 'w': write_pct = atoi(optarg); break;
+        case 'D': device_path = optarg; be = &dev_backend; break;
+        case 'S': show_stats = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (nthreads < 1 || nchannels < 1 || nsizes < 1 || seconds <= 0 || write_pct < 0 || write_pct > 100)
+        usage(argv[0]);
+    for (i = 0; i < nsizes; i++)
+        if (sizes[i] == 0 || sizes[i] > MESSAGE_MAX_LEN_LIMIT) {
+            fprintf(stderr, "message sizes must be 1..%d\n", MESSAGE_MAX_LEN_LIMIT);
+            return 1;
+        }
+    if (be == &lib_backend && msl_init() != 0) {
+        fprintf(stderr, "msl_init failed\n");
+        return 1;
+    }
+
+    printf("# backend: %s, %d%% writes, %.1fs per run\n", device_path ? device_path : "libmessage_slot",
+           write_pct, seconds);
+    printf("%9s %7s %7s %12s %9s %8s %8s %8s %8s %9s %7s %6s\n", "channels", "size", "threads", "msgs/s", "MiB/s",
+           "p50(ns)", "p90", "p99", "p99.9", "max", "misses", "errors");
+    for (i = 0; i < nchannels; i++)
+        for (j = 0; j < nsizes; j++) {
+            // each run gets fresh channel ids (and with the library a fresh slot) so runs don't share state
+            struct run r = {.minor = minor++ % 256, .first_channel = next_channel, .channels = channels[i],
+                            .size = sizes[j], .write_pct = write_pct};
+            next_channel += channels[i];
+            run_one(&r, nthreads, seconds);
+        }
+    if (be == &lib_backend)
+        msl_exit();
+    return 0;
+}
@@ -10,6 +10,7 @@ DEV0="/dev/msg_slot0"   # minor 0
 DEV1="/dev/msg_slot1"   # minor 1
 SENDER=./message_sender
 READER=./message_reader
+CTL=./message_ctl
 PASS=0
 FAIL=0
 CFLAGS="-O3 -Wall -std=c11"
@@ -45,8 +46,11 @@ done
 echo "Running tests …"
 
 # ── helpers ───────────────────────────────────────────────────────
-send()  { "$SENDER"  "$1" "$2" "$3" "$4"  >/dev/null 2>&1; }
+# optional 5th arg: max_len for the slot (non-numeric 5th args are expect_fail descriptions)
+send()  { local max=(); [[ ${5-} =~ ^[0-9]+$ ]] && max=("$5")
+          "$SENDER"  "$1" "$2" "$3" "$4" "${max[@]}"  >/dev/null 2>&1; }
 read_msg() { "$READER" "$1" "$2" 2>/dev/null; }
+ctl()   { "$CTL" "$1" "$2" "$3" >/dev/null 2>&1; }
 expect_fail() { "$@" >/dev/null 2>&1 && fail "$3" || pass; }
 
 # 1. basic write/read  ----------------------------------------------------------
@@ -136,6 +140,75 @@ BIGID=5000000
 send "$DEV0" $BIGID 0 "big"
 [[ $(read_msg "$DEV0" $BIGID) == "big" ]] && pass || fail "large channel id"
 
+# 16. raised per-slot max length ( > 128 )  -----------------------------------
+#   (uses minor 1 so the 128-byte default on minor 0 stays intact)
+BIG4K=$(head -c 4000 < /dev/zero | tr '\0' 'b')
+send "$DEV1" 200 0 "$BIG4K" 4096
+[[ $(read_msg "$DEV1" 200) == "$BIG4K" ]] && pass || fail "large message after SET_MAXLEN"
+
+# 17. write above the raised limit  --------------------------------------------
+BIG5K=$(head -c 5000 < /dev/zero | tr '\0' 'c')
+expect_fail send "$DEV1" 201 0 "$BIG5K" "write above raised limit"
+
+# 18. max length beyond MESSAGE_MAX_LEN_LIMIT  ---------------------------------
+expect_fail send "$DEV1" 202 0 "x" 20000 "SET_MAXLEN above limit"
+
+# 19. delete channel  ----------------------------------------------------------
+send "$DEV0" 300 0 "gone"
+ctl "$DEV0" del 300
+expect_fail read_msg "$DEV0" 300 "read deleted channel"
+
+# 20. delete unknown channel  --------------------------------------------------
+expect_fail ctl "$DEV0" del 301 "delete unknown channel"
+
+# 21. per-slot channel cap  ----------------------------------------------------
+#   minor 1 holds channels 1 and 200 at this point
+ctl "$DEV1" max-channels 3
+send "$DEV1" 203 0 "third"
+if send "$DEV1" 204 0 "fourth"; then fail "channel cap"; else
+  ctl "$DEV1" del 203
+  send "$DEV1" 204 0 "fourth" && pass || fail "channel cap after delete"
+fi
+ctl "$DEV1" max-channels 0
+
+# 22. per-slot byte cap  -------------------------------------------------------
+ctl "$DEV0" max-bytes 1
+expect_fail send "$DEV0" 302 0 "toolong" "byte cap"
+ctl "$DEV0" max-bytes 0
+
+# 23. idle eviction  -----------------------------------------------------------
+ctl "$DEV0" idle 1
+send "$DEV0" 400 0 "idle"
+sleep 3
+expect_fail read_msg "$DEV0" 400 "idle channel evicted"
+ctl "$DEV0" idle 0
+
+# 24. digit-masking filter (longer than a machine word to cover the SWAR path) -
+send "$DEV0" 500 2 "card 1234-5678-9012, cvv 987"
+[[ $(read_msg "$DEV0" 500) == "card ****-****-****, cvv ***" ]] && pass || fail "mask digits filter"
+
+# 25. uppercase filter  --------------------------------------------------------
+send "$DEV0" 501 3 "hello, World 42 - abcxyz"
+[[ $(read_msg "$DEV0" 501) == "HELLO, WORLD 42 - ABCXYZ" ]] && pass || fail "upper filter"
+
+# 26. censor filter across whole 3-word blocks  --------------------------------
+send "$DEV0" 502 1 "abcdefghijklmnopqrstuvwxyzABCDEFGHIJ"
+[[ $(read_msg "$DEV0" 502) == "ab#de#gh#jk#mn#pq#st#vw#yz#BC#EF#HI#" ]] && pass || fail "long censor write/read"
+
+# 27. unknown filter id  -------------------------------------------------------
+expect_fail send "$DEV0" 503 9 "x" "unknown filter"
+
+# 28. statistics  --------------------------------------------------------------
+SYS=/sys/kernel/message_slot
+[[ -r $SYS/slots && $(cat "$SYS/writes") -gt 0 ]] && pass || fail "sysfs summary"
+DBG=/sys/kernel/debug/message_slot/0
+if [[ -d $DBG ]]; then
+  grep -q "^misses [1-9]" "$DBG/stats" && pass || fail "debugfs stats"
+  grep -q "^501 " "$DBG/channels" && pass || fail "debugfs channels"
+else
+  echo "debugfs not mounted, skipping debugfs checks"
+fi
+
 # ── Summary ────────────────────────────────────────────────────────
 TOTAL=$((PASS+FAIL))
 echo "────────────────────────────────────────"
@@ -0,0 +1,484 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdarg.h>
+#include <time.h>
+#include "kshim.h"
+#include "message_slot_user.h"
+
+// Implementation of kshim.h plus the msl_* entry points. message_slot.c itself is compiled unchanged against kshim.h
+// and registers its file_operations through register_chrdev(), which is where msl_* picks them up.
+
+int kshim_module_init(void);
+void kshim_module_exit(void);
+
+static const struct file_operations *registered_fops;
+
+struct msl_file {
+    struct inode inode;
+    struct file file;
+};
+
+// ---------- slab ----------
+struct kmem_cache {
+    char *name;
+    size_t size;
+};
+
+char *kasprintf(gfp_t gfp, const char *fmt, ...) {
+    va_list ap;
+    char *s;
+    (void)gfp;
+    va_start(ap, fmt);
+    if (vasprintf(&s, fmt, ap) < 0)
+        s = NULL;
+    va_end(ap);
+    return s;
+}
+
+struct kmem_cache *kmem_cache_create_usercopy(const char *name, unsigned int size, unsigned int align,
+                                              unsigned int flags, unsigned int useroffset, unsigned int usersize,
+                                              void (*ctor)(void *)) {
+    struct kmem_cache *cache = malloc(sizeof(*cache));
+    (void)align, (void)flags, (void)useroffset, (void)usersize, (void)ctor;
+    if (!cache)
+        return NULL;
+    cache->name = strdup(name);
+    cache->size = size;
+    return cache;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache, gfp_t flags) {
+    (void)flags;
+    return malloc(cache->size);
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj) {
+    (void)cache;
+    free(obj);
+}
+
+void kmem_cache_destroy(struct kmem_cache *cache) {
+    if (!cache)
+        return;
+    free(cache->name);
+    free(cache);
+}
+
+// ---------- jiffies ----------
+unsigned long kshim_jiffies(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * HZ + (unsigned long)ts.tv_nsec / (1000000000 / HZ);
+}
+
+// ---------- delayed work ----------
+static pthread_mutex_t wq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wq_cond; // new work scheduled / a work finished running
+static struct delayed_work *wq_pending;
+static int wq_started;
+
+static void wq_unlink(struct delayed_work *dwork) {
+    struct delayed_work **link;
+    for (link = &wq_pending; *link; link = &(*link)->next)
+        if (*link == dwork) {
+            *link = dwork->next;
+            break;
+        }
+    dwork->pending = 0;
+}
+
+static void *wq_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&wq_lock);
+    for (;;) {
+        struct delayed_work *dwork, *next = NULL;
+        unsigned long now = jiffies;
+        for (dwork = wq_pending; dwork; dwork = dwork->next)
+            if (!next || time_after(next->due, dwork->due))
+                next = dwork;
+        if (!next) {
+            pthread_cond_wait(&wq_cond, &wq_lock);
+        } else if (time_after(next->due, now)) {
+            struct timespec ts;
+            unsigned long ms = (next->due - now) * 1000 / HZ;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += ms / 1000;
+            ts.tv_nsec += (long)(ms % 1000) * 1000000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&wq_cond, &wq_lock, &ts);
+        } else {
+            wq_unlink(next);
+            next->running = 1;
+            pthread_mutex_unlock(&wq_lock);
+            next->func(&next->work);
+            pthread_mutex_lock(&wq_lock);
+            next->running = 0;
+            pthread_cond_broadcast(&wq_cond);
+        }
+    }
+    return NULL;
+}
+
+// expects wq_lock held
+static int wq_start(void) {
+    pthread_condattr_t attr;
+    pthread_t thread;
+    if (wq_started)
+        return 0;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wq_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&thread, NULL, wq_thread, NULL))
+        return -1;
+    pthread_detach(thread);
+    wq_started = 1;
+    return 0;
+}
+
+int schedule_delayed_work(struct delayed_work *dwork, unsigned long delay) {
+    int queued = 0;
+    pthread_mutex_lock(&wq_lock);
+    if (!dwork->pending && !dwork->canceling && wq_start() == 0) {
+        dwork->due = jiffies + delay;
+        dwork->pending = 1;
+        dwork->next = wq_pending;
+        wq_pending = dwork;
+        pthread_cond_broadcast(&wq_cond);
+        queued = 1;
+    }
+    pthread_mutex_unlock(&wq_lock);
+    return queued;
+}
+
+// like the kernel's: the work is neither pending nor running on return, even if it tried to re-arm itself
+int cancel_delayed_work_sync(struct delayed_work *dwork) {
+    int was_pending;
+    pthread_mutex_lock(&wq_lock);
+    dwork->canceling = 1;
+    was_pending = dwork->pending;
+    if (was_pending)
+        wq_unlink(dwork);
+    while (dwork->running)
+        pthread_cond_wait(&wq_cond, &wq_lock);
+    if (dwork->pending) // re-armed by the run we waited for
+        wq_unlink(dwork);
+    dwork->canceling = 0;
+    pthread_mutex_unlock(&wq_lock);
+    return was_pending;
+}
+
+// ---------- iov_iter ----------
+static size_t iter_copy(struct iov_iter *i, void *buf, size_t bytes, int to_iter) {
+    size_t done = 0;
+    while (done < bytes && i->count && i->nr_segs) {
+        size_t chunk = i->iov->iov_len - i->iov_offset;
+        char *base = (char *)i->iov->iov_base + i->iov_offset;
+        if (chunk > bytes - done)
+            chunk = bytes - done;
+        if (to_iter)
+            memcpy(base, (char *)buf + done, chunk);
+        else
+            memcpy((char *)buf + done, base, chunk);
+        done += chunk;
+        i->count -= chunk;
+        i->iov_offset += chunk;
+        if (i->iov_offset == i->iov->iov_len) {
+            i->iov++;
+            i->nr_segs--;
+            i->iov_offset = 0;
+        }
+    }
+    return done;
+}
+
+size_t copy_from_iter(void *addr, size_t bytes, struct iov_iter *i) {
+    return iter_copy(i, addr, bytes, 0);
+}
+
+size_t copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i) {
+    return iter_copy(i, (void *)addr, bytes, 1);
+}
+
+// ---------- percpu ----------
+void *kshim_alloc_percpu(size_t size) {
+    if (size > KSHIM_PERCPU_STRIDE)
+        return NULL;
+    return calloc(KSHIM_NR_CPUS, KSHIM_PERCPU_STRIDE);
+}
+
+int kshim_this_cpu(void) {
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu % KSHIM_NR_CPUS;
+}
+
+// ---------- seq_file / debugfs ----------
+int seq_printf(struct seq_file *m, const char *fmt, ...) {
+    va_list ap;
+    int n;
+    for (;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(m->buf + m->count, m->size - m->count, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return n;
+        if (m->count + n < m->size)
+            break;
+        char *grown = realloc(m->buf, (m->count + n + 1) * 2);
+        if (!grown)
+            return -ENOMEM;
+        m->buf = grown;
+        m->size = (m->count + n + 1) * 2;
+    }
+    m->count += n;
+    return 0;
+}
+
+void seq_puts(struct seq_file *m, const char *s) {
+    seq_printf(m, "%s", s);
+}
+
+// directories and files, identified by their full path
+struct dentry {
+    char *path;
+    void *data;
+    const struct file_operations *fops; // NULL for directories
+    struct dentry *next;
+};
+
+static struct dentry *debugfs_entries;
+static pthread_mutex_t debugfs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct dentry *debugfs_add(const char *name, struct dentry *parent, void *data,
+                                  const struct file_operations *fops) {
+    struct dentry *d = calloc(1, sizeof(*d));
+    if (!d)
+        return NULL;
+    if (parent ? asprintf(&d->path, "%s/%s", parent->path, name) < 0 : !(d->path = strdup(name))) {
+        free(d);
+        return NULL;
+    }
+    d->data = data;
+    d->fops = fops;
+    pthread_mutex_lock(&debugfs_lock);
+    d->next = debugfs_entries;
+    debugfs_entries = d;
+    pthread_mutex_unlock(&debugfs_lock);
+    return d;
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent) {
+    return debugfs_add(name, parent, NULL, NULL);
+}
+
+struct dentry *debugfs_create_file(const char *name, umode_t mode, struct dentry *parent, void *data,
+                                   const struct file_operations *fops) {
+    (void)mode;
+    return debugfs_add(name, parent, data, fops);
+}
+
+void debugfs_remove_recursive(struct dentry *dentry) {
+    struct dentry **link, *d;
+    size_t len;
+    char *prefix;
+    if (!dentry)
+        return;
+    prefix = strdup(dentry->path); // dentry itself is freed on the way
+    len = strlen(prefix);
+    pthread_mutex_lock(&debugfs_lock);
+    for (link = &debugfs_entries; (d = *link);) {
+        if (strncmp(d->path, prefix, len) == 0 && (d->path[len] == '\0' || d->path[len] == '/')) {
+            *link = d->next;
+            free(d->path);
+            free(d);
+        } else {
+            link = &d->next;
+        }
+    }
+    pthread_mutex_unlock(&debugfs_lock);
+    free(prefix);
+}
+
+ssize_t msl_debugfs_read(const char *path, char *buf, size_t size) {
+    struct seq_file m = {0};
+    struct dentry *d;
+    ssize_t len;
+    pthread_mutex_lock(&debugfs_lock);
+    for (d = debugfs_entries; d && !(d->fops && strcmp(d->path, path) == 0); d = d->next) {}
+    pthread_mutex_unlock(&debugfs_lock);
+    if (!d)
+        return -ENOENT;
+    m.private = d->data;
+    if (seq_printf(&m, "%s", "") < 0 || d->fops->show(&m, NULL) < 0) {
+        free(m.buf);
+        return -ENOMEM;
+    }
+    len = m.count < size ? (ssize_t)m.count : (ssize_t)size - 1;
+    memcpy(buf, m.buf, len);
+    buf[len] = '\0';
+    free(m.buf);
+    return len;
+}
+
+// ---------- kobject / sysfs ----------
+struct kobject {
+    char *name;
+    const struct attribute_group *group;
+    struct kobject *next;
+};
+
+struct kobject *kernel_kobj; // the kobjects are top level in the shim, so /sys/kernel is just NULL
+static struct kobject *kobjects;
+static pthread_mutex_t kobject_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct kobject *kobject_create_and_add(const char *name, struct kobject *parent) {
+    struct kobject *kobj = calloc(1, sizeof(*kobj));
+    (void)parent;
+    if (!kobj || !(kobj->name = strdup(name))) {
+        free(kobj);
+        return NULL;
+    }
+    pthread_mutex_lock(&kobject_lock);
+    kobj->next = kobjects;
+    kobjects = kobj;
+    pthread_mutex_unlock(&kobject_lock);
+    return kobj;
+}
+
+void kobject_put(struct kobject *kobj) {
+    struct kobject **link;
+    if (!kobj)
+        return;
+    pthread_mutex_lock(&kobject_lock);
+    for (link = &kobjects; *link && *link != kobj; link = &(*link)->next) {}
+    if (*link)
+        *link = kobj->next;
+    pthread_mutex_unlock(&kobject_lock);
+    free(kobj->name);
+    free(kobj);
+}
+
+int sysfs_create_group(struct kobject *kobj, const struct attribute_group *grp) {
+    kobj->group = grp;
+    return 0;
+}
+
+int sysfs_emit(char *buf, const char *fmt, ...) {
+    va_list ap;
+    int n;
+    va_start(ap, fmt);
+    n = vsnprintf(buf, PAGE_SIZE, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+ssize_t msl_sysfs_read(const char *path, char *buf, size_t size) {
+    const char *slash = strchr(path, '/');
+    struct kobject *kobj;
+    struct attribute **attr;
+    char page[PAGE_SIZE];
+    ssize_t len = -ENOENT;
+    if (!slash)
+        return -ENOENT;
+    pthread_mutex_lock(&kobject_lock);
+    for (kobj = kobjects; kobj; kobj = kobj->next)
+        if (strlen(kobj->name) == (size_t)(slash - path) && strncmp(kobj->name, path, slash - path) == 0)
+            break;
+    pthread_mutex_unlock(&kobject_lock);
+    if (!kobj || !kobj->group)
+        return -ENOENT;
+    for (attr = kobj->group->attrs; *attr; attr++) {
+        if (strcmp((*attr)->name, slash + 1) == 0) {
+            struct kobj_attribute *kattr = container_of(*attr, struct kobj_attribute, attr);
+            len = kattr->show(kobj, kattr, page);
+            if (len >= 0) {
+                if ((size_t)len >= size)
+                    len = size - 1;
+                memcpy(buf, page, len);
+                buf[len] = '\0';
+            }
+            break;
+        }
+    }
+    return len;
+}
+
+// ---------- chrdev ----------
+int register_chrdev(unsigned int major, const char *name, const struct file_operations *fops) {
+    (void)major, (void)name;
+    registered_fops = fops;
+    return 0;
+}
+
+void unregister_chrdev(unsigned int major, const char *name) {
+    (void)major, (void)name;
+    registered_fops = NULL;
+}
+
+// ---------- msl_* ----------
+int msl_init(void) {
+    return kshim_module_init();
+}
+
+void msl_exit(void) {
+    kshim_module_exit();
+}
+
+struct msl_file *msl_open(unsigned int minor) {
+    struct msl_file *f = calloc(1, sizeof(*f));
+    int rc;
+    if (!f)
+        return NULL;
+    f->inode.minor = minor;
+    f->file.f_inode = &f->inode;
+    rc = registered_fops->open(&f->inode, &f->file);
+    if (rc < 0) {
+        free(f);
+        errno = -rc;
+        return NULL;
+    }
+    return f;
+}
+
+int msl_close(struct msl_file *f) {
+    int rc = registered_fops->release(&f->inode, &f->file);
+    free(f);
+    return rc;
+}
+
+long msl_ioctl(struct msl_file *f, unsigned int cmd, unsigned long arg) {
+    return registered_fops->unlocked_ioctl(&f->file, cmd, arg);
+}
+
+static ssize_t iov_total(const struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    int i;
+    for (i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+    return total;
+}
+
+ssize_t msl_writev(struct msl_file *f, const struct iovec *iov, int iovcnt) {
+    struct kiocb kiocb = {.ki_filp = &f->file};
+    struct iov_iter iter = {.iov = iov, .nr_segs = iovcnt, .iov_offset = 0, .count = iov_total(iov, iovcnt)};
+    return registered_fops->write_iter(&kiocb, &iter);
+}
+
+ssize_t msl_readv(struct msl_file *f, const struct iovec *iov, int iovcnt) {
+    struct kiocb kiocb = {.ki_filp = &f->file};
+    struct iov_iter iter = {.iov = iov, .nr_segs = iovcnt, .iov_offset = 0, .count = iov_total(iov, iovcnt)};
+    return registered_fops->read_iter(&kiocb, &iter);
+}
+
+ssize_t msl_write(struct msl_file *f, const void *buf, size_t len) {
+    struct iovec iov = {.iov_base = (void *)buf, .iov_len = len};
+    return msl_writev(f, &iov, 1);
+}
+
+ssize_t msl_read(struct msl_file *f, void *buf, size_t len) {
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    return msl_readv(f, &iov, 1);
+}
@@ -0,0 +1,34 @@
+#ifndef MESSAGE_SLOT_USER_H
+#define MESSAGE_SLOT_USER_H
+
+// libmessage_slot.a: the message_slot driver logic built as a user-space library (message_slot.c + kshim.h).
+// Every call maps 1:1 onto the device's file operations and returns what the syscall would: a byte count or 0 on
+// success, -errno on failure. A minor number stands in for /dev/message_slot<minor>.
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "message_slot.h"
+
+struct msl_file;
+
+// module load/unload. msl_exit expects all files to be closed
+int msl_init(void);
+void msl_exit(void);
+
+// open(2)/close(2). msl_open returns NULL and sets errno on failure
+struct msl_file *msl_open(unsigned int minor);
+int msl_close(struct msl_file *file);
+
+long msl_ioctl(struct msl_file *file, unsigned int cmd, unsigned long arg);
+ssize_t msl_write(struct msl_file *file, const void *buf, size_t len);
+ssize_t msl_read(struct msl_file *file, void *buf, size_t len);
+ssize_t msl_writev(struct msl_file *file, const struct iovec *iov, int iovcnt);
+ssize_t msl_readv(struct msl_file *file, const struct iovec *iov, int iovcnt);
+
+// The driver's statistics, as the kernel would show them. Paths are relative to the debugfs/sysfs roots, e.g.
+// msl_debugfs_read("message_slot/0/top", ...) or msl_sysfs_read("message_slot/writes", ...).
+// Both return the text length (truncated to size - 1, always NUL terminated) or -ENOENT.
+ssize_t msl_debugfs_read(const char *path, char *buf, size_t size);
+ssize_t msl_sysfs_read(const char *path, char *buf, size_t size);
+
+#endif //MESSAGE_SLOT_USER_H
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "message_slot_user.h"
+
+// Functional checks against libmessage_slot.a - the message_slot_tester.sh cases that matter for the driver logic,
+// runnable without root/insmod/mknod.
+
+static int failed;
+
+static void check(int ok, const char *name) {
+    printf("%s: %s\n", name, ok ? "passed" : "failed");
+    if (!ok)
+        failed++;
+}
+
+// write msg on (minor, channel) through a fresh fd with the given filter
+static ssize_t send_msg(unsigned int minor, unsigned long channel, unsigned int filter, const char *msg) {
+    struct msl_file *f = msl_open(minor);
+    ssize_t n;
+    msl_ioctl(f, MSG_SLOT_SET_FILTER, filter);
+    msl_ioctl(f, MSG_SLOT_CHANNEL, channel);
+    n = msl_write(f, msg, strlen(msg));
+    msl_close(f);
+    return n;
+}
+
+// read (minor, channel) into buf (NUL terminated) through a fresh fd
+static ssize_t read_msg(unsigned int minor, unsigned long channel, char *buf, size_t size) {
+    struct msl_file *f = msl_open(minor);
+    ssize_t n;
+    msl_ioctl(f, MSG_SLOT_CHANNEL, channel);
+    n = msl_read(f, buf, size - 1);
+    buf[n > 0 ? n : 0] = '\0';
+    msl_close(f);
+    return n;
+}
+
+int main(void) {
+    static char big[MESSAGE_MAX_LEN_LIMIT + 1], buf[MESSAGE_MAX_LEN_LIMIT + 1];
+    struct msl_file *f;
+    struct iovec iov[3];
+
+    if (msl_init() != 0) {
+        printf("msl_init failed\n");
+        return 1;
+    }
+
+    send_msg(0, 11, MSG_FILTER_NONE, "HelloWorld");
+    check(read_msg(0, 11, buf, sizeof(buf)) == 10 && strcmp(buf, "HelloWorld") == 0, "basic write/read");
+
+    send_msg(0, 22, MSG_FILTER_CENSOR, "abcdefghijklmnopqrstuvwxyz");
+    read_msg(0, 22, buf, sizeof(buf));
+    check(strcmp(buf, "ab#de#gh#jk#mn#pq#st#vw#yz") == 0, "censor filter");
+
+    send_msg(0, 23, MSG_FILTER_MASK_DIGITS, "pin 1234, id 5678");
+    read_msg(0, 23, buf, sizeof(buf));
+    check(strcmp(buf, "pin ****, id ****") == 0, "mask digits filter");
+
+    check(read_msg(0, 33, buf, sizeof(buf)) == -EWOULDBLOCK, "read empty channel");
+
+    memset(big, 'a', MESSAGE_MAX_LEN + 1);
+    big[MESSAGE_MAX_LEN + 1] = '\0';
+    check(send_msg(0, 44, MSG_FILTER_NONE, big) == -EMSGSIZE, "oversize write");
+    check(send_msg(0, 55, MSG_FILTER_NONE, "") == -EMSGSIZE, "zero-size write");
+
+    f = msl_open(0);
+    check(msl_write(f, "data", 4) == -EINVAL && msl_read(f, buf, 4) == -EINVAL, "write/read without channel");
+    msl_ioctl(f, MSG_SLOT_CHANNEL, 11);
+    check(msl_read(f, buf, 5) == -ENOSPC, "small buffer read");
+    msl_close(f);
+
+    send_msg(1, 11, MSG_FILTER_NONE, "slot1");
+    read_msg(0, 11, buf, sizeof(buf));
+    check(strcmp(buf, "HelloWorld") == 0, "slots are separate");
+
+    // large messages after raising the limit, assembled from several iovecs
+    f = msl_open(2);
+    check(msl_ioctl(f, MSG_SLOT_SET_MAXLEN, MESSAGE_MAX_LEN_LIMIT + 1) == -EINVAL, "SET_MAXLEN above limit");
+    msl_ioctl(f, MSG_SLOT_SET_MAXLEN, 8192);
+    msl_ioctl(f, MSG_SLOT_CHANNEL, 1);
+    memset(big, 'x', 4000);
+    memset(big + 4000, 'y', 4000);
+    iov[0] = (struct iovec){big, 4000};
+    iov[1] = (struct iovec){big + 4000, 4000};
+    iov[2] = (struct iovec){big, 192};
+    check(msl_writev(f, iov, 3) == 8192, "writev of a large message");
+    check(msl_read(f, buf, sizeof(buf)) == 8192 && memcmp(buf, big, 8000) == 0 && buf[8191] == 'x',
+          "read of a large message");
+    check(msl_write(f, big, 8193) == -EMSGSIZE, "write above raised limit");
+    msl_close(f);
+
+    // reclamation and limits
+    send_msg(3, 1, MSG_FILTER_NONE, "one");
+    f = msl_open(3);
+    check(msl_ioctl(f, MSG_SLOT_DEL_CHANNEL, 1) == 0 && msl_ioctl(f, MSG_SLOT_DEL_CHANNEL, 1) == -ENOENT,
+          "delete channel");
+    check(read_msg(3, 1, buf, sizeof(buf)) == -EWOULDBLOCK, "read deleted channel");
+    msl_ioctl(f, MSG_SLOT_SET_MAX_CHANNELS, 2);
+    send_msg(3, 1, MSG_FILTER_NONE, "a");
+    send_msg(3, 2, MSG_FILTER_NONE, "b");
+    check(send_msg(3, 3, MSG_FILTER_NONE, "c") == -EDQUOT, "channel cap");
+    msl_ioctl(f, MSG_SLOT_SET_MAX_CHANNELS, 0);
+    msl_ioctl(f, MSG_SLOT_SET_MAX_BYTES, 4);
+    check(send_msg(3, 4, MSG_FILTER_NONE, "abc") == -EDQUOT && send_msg(3, 1, MSG_FILTER_NONE, "ab") == 2,
+          "byte cap");
+    msl_ioctl(f, MSG_SLOT_SET_MAX_BYTES, 0);
+
+    // a channel bound to an open fd survives idle eviction, an unbound one doesn't
+    msl_ioctl(f, MSG_SLOT_CHANNEL, 2);
+    msl_read(f, buf, sizeof(buf));
+    msl_ioctl(f, MSG_SLOT_SET_IDLE_TIMEOUT, 1);
+    sleep(3);
+    check(read_msg(3, 1, buf, sizeof(buf)) == -EWOULDBLOCK, "idle channel evicted");
+    check(msl_read(f, buf, sizeof(buf)) == 1, "bound channel kept");
+    msl_ioctl(f, MSG_SLOT_SET_IDLE_TIMEOUT, 0);
+    msl_close(f);
+
+    // statistics: slot 4 sees 3 writes on channel 7, 1 read and 1 miss
+    send_msg(4, 7, MSG_FILTER_NONE, "abc");
+    send_msg(4, 7, MSG_FILTER_NONE, "de");
+    send_msg(4, 8, MSG_FILTER_NONE, "f");
+    read_msg(4, 7, buf, sizeof(buf));
+    read_msg(4, 9, buf, sizeof(buf));
+    check(msl_debugfs_read("message_slot/4/stats", buf, sizeof(buf)) > 0 && strstr(buf, "writes 3\n") &&
+          strstr(buf, "reads 1\n") && strstr(buf, "bytes_written 6\n") && strstr(buf, "misses 1\n") &&
+          strstr(buf, "channels 2\n"), "debugfs stats");
+    check(msl_debugfs_read("message_slot/4/top", buf, sizeof(buf)) > 0 &&
+          strstr(buf, "bytes_read\n7 2 0 2 1 5 2\n8 1 0 1 0 1 0\n"), "debugfs top");
+    check(msl_debugfs_read("message_slot/4/nonexistent", buf, sizeof(buf)) == -ENOENT, "debugfs missing file");
+    check(msl_sysfs_read("message_slot/slots", buf, sizeof(buf)) > 0 && strcmp(buf, "5\n") == 0 &&
+          msl_sysfs_read("message_slot/writes", buf, sizeof(buf)) > 0 && atoi(buf) >= 3, "sysfs summary");
+
+    msl_exit();
+    printf("%s\n", failed ? "SOME TESTS FAILED" : "all tests passed");
+    return failed != 0;
+}
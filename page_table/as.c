@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os.h"
+#include "as.h"
+
+#define NASIDS		(1U << AS_ASID_BITS)
+#define ASID_MASK	(NASIDS - 1)
+
+struct address_space {
+	uint64_t pt;
+	uint64_t asid; /* generation << AS_ASID_BITS | ASID, stale when the generation isn't the current one */
+	struct address_space* prev;
+	struct address_space* next;
+};
+
+/*
+ * A TLB entry's tag is vpn << 17 | ASID << 1 | 1, so one compare checks the page, the space and validity.
+ * The set comes from the vpn mixed with the ASID, so spaces using the same addresses don't all land in one set.
+ */
+struct tlb_entry {
+	uint64_t tag;
+	uint64_t ppn;
+};
+
+static struct tlb_entry tlb[AS_TLB_SETS][AS_TLB_WAYS];
+static uint8_t tlb_victim[AS_TLB_SETS]; /* round robin replacement */
+
+static uint64_t asid_generation = 1;
+static uint64_t asid_map[NASIDS / 64 + 1]; /* ASIDs taken in this generation. 0 is never handed out */
+static unsigned int asid_next = 1;
+
+static struct address_space* spaces;
+static struct address_space* current;
+static struct as_stats stats;
+
+static inline uint64_t tlb_tag(uint64_t vpn, unsigned int asid)
+{
+	return vpn << 17 | (uint64_t)asid << 1 | 1;
+}
+
+static inline unsigned int tlb_set(uint64_t vpn, unsigned int asid)
+{
+	return (vpn ^ asid * 0x9e5U) & (AS_TLB_SETS - 1);
+}
+
+static inline int asid_valid(const struct address_space* as)
+{
+	return as->asid >> AS_ASID_BITS == asid_generation;
+}
+
+static void tlb_invalidate(uint64_t vpn, unsigned int asid)
+{
+	struct tlb_entry* set = tlb[tlb_set(vpn, asid)];
+	uint64_t tag = tlb_tag(vpn, asid);
+
+	for (int way = 0; way < AS_TLB_WAYS; way++)
+		if (set[way].tag == tag)
+			set[way].tag = 0;
+}
+
+/* drop all of asid's entries, before it's handed out again */
+static void tlb_invalidate_asid(unsigned int asid)
+{
+	for (int set = 0; set < AS_TLB_SETS; set++)
+		for (int way = 0; way < AS_TLB_WAYS; way++)
+			if ((tlb[set][way].tag & ((uint64_t)ASID_MASK << 1 | 1)) == ((uint64_t)asid << 1 | 1))
+				tlb[set][way].tag = 0;
+}
+
+/* give as an ASID of the current generation, starting a new generation if there's none left */
+static void asid_assign(struct address_space* as)
+{
+	unsigned int asid;
+
+	for (unsigned int i = 0; i < NASIDS - 1; i++) {
+		asid = asid_next;
+		asid_next = asid_next == ASID_MASK ? 1 : asid_next + 1;
+		if (!(asid_map[asid / 64] & (1ULL << (asid % 64))))
+			goto found;
+	}
+
+	/* every ASID is taken: whatever the TLB holds belongs to the old generation */
+	asid_generation++;
+	stats.rollovers++;
+	memset(asid_map, 0, sizeof(asid_map));
+	memset(tlb, 0, sizeof(tlb));
+	asid = 1;
+	asid_next = 2;
+found:
+	asid_map[asid / 64] |= 1ULL << (asid % 64);
+	as->asid = asid_generation << AS_ASID_BITS | asid;
+}
+
+struct address_space* as_register(uint64_t pt)
+{
+	struct address_space* as = calloc(1, sizeof(*as));
+
+	if (!as)
+		return NULL;
+	as->pt = pt;
+	as->next = spaces;
+	if (spaces)
+		spaces->prev = as;
+	spaces = as;
+	return as;
+}
+
+struct address_space* as_create(int layout)
+{
+	struct address_space* as = as_register(0);
+
+	if (as)
+		as->pt = page_table_create(layout);
+	return as;
+}
+
+void as_destroy(struct address_space* as)
+{
+	if (asid_valid(as)) {
+		unsigned int asid = as->asid & ASID_MASK;
+		tlb_invalidate_asid(asid);
+		asid_map[asid / 64] &= ~(1ULL << (asid % 64));
+	}
+	if (current == as)
+		current = NULL;
+	if (as->prev)
+		as->prev->next = as->next;
+	else
+		spaces = as->next;
+	if (as->next)
+		as->next->prev = as->prev;
+	page_table_destroy(as->pt);
+	free(as);
+}
+
+void as_destroy_all(void)
+{
+	while (spaces)
+		as_destroy(spaces);
+}
+
+uint64_t as_page_table(const struct address_space* as)
+{
+	return as->pt;
+}
+
+void as_switch(struct address_space* as)
+{
+	if (as && !asid_valid(as))
+		asid_assign(as);
+	current = as;
+}
+
+struct address_space* as_current(void)
+{
+	return current;
+}
+
+uint64_t as_translate(uint64_t vpn)
+{
+	unsigned int asid, index;
+	struct tlb_entry* set;
+	uint64_t tag, ppn;
+
+	if (!current)
+		return NO_MAPPING;
+	asid = current->asid & ASID_MASK;
+	index = tlb_set(vpn, asid);
+	set = tlb[index];
+	tag = tlb_tag(vpn, asid);
+	for (int way = 0; way < AS_TLB_WAYS; way++) {
+		if (set[way].tag == tag) {
+			stats.hits++;
+			return set[way].ppn;
+		}
+	}
+
+	stats.misses++;
+	ppn = page_table_query(current->pt, vpn);
+	if (ppn != NO_MAPPING) {
+		set[tlb_victim[index]].tag = tag;
+		set[tlb_victim[index]].ppn = ppn;
+		tlb_victim[index] = (tlb_victim[index] + 1) % AS_TLB_WAYS;
+	}
+	return ppn;
+}
+
+void as_map(struct address_space* as, uint64_t vpn, uint64_t ppn)
+{
+	page_table_update(as->pt, vpn, ppn);
+	if (asid_valid(as))
+		tlb_invalidate(vpn, as->asid & ASID_MASK);
+}
+
+void as_get_stats(struct as_stats* out)
+{
+	*out = stats;
+}
@@ -0,0 +1,39 @@
+#include <stdint.h>
+
+/*
+ * Address spaces: page tables managed as a set, translated through one software TLB shared by all of them.
+ * TLB entries are tagged with the space's ASID, so switching spaces flushes nothing. There are far fewer ASIDs
+ * than spaces: a space gets one when it's switched to, and when they run out a new generation starts, with a full
+ * flush, and every space gets a new ASID the next time it runs.
+ */
+
+#define AS_ASID_BITS	8	/* at most 16 */
+#define AS_TLB_SETS	256
+#define AS_TLB_WAYS	4
+
+struct address_space;
+
+struct as_stats {
+	uint64_t hits;
+	uint64_t misses;	/* walks of a page table */
+	uint64_t rollovers;	/* ASID generations started, each a full TLB flush */
+};
+
+/* a new space with an empty table of the given layout (PT_LAYOUT_*), or one for an existing table. NULL on failure */
+struct address_space* as_create(int layout);
+struct address_space* as_register(uint64_t pt);
+/* tear the space down: its TLB entries, its ASID and every frame of its table */
+void as_destroy(struct address_space* as);
+void as_destroy_all(void);
+
+uint64_t as_page_table(const struct address_space* as);
+
+/* make as the current space, the one as_translate() works on */
+void as_switch(struct address_space* as);
+struct address_space* as_current(void);
+/* vpn's ppn in the current space, or NO_MAPPING */
+uint64_t as_translate(uint64_t vpn);
+/* page_table_update() on the space's table, keeping the TLB coherent */
+void as_map(struct address_space* as, uint64_t vpn, uint64_t ppn);
+
+void as_get_stats(struct as_stats* stats);
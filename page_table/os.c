@@ -4,22 +4,31 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <err.h>
 #include <sys/mman.h>
 
 #include "os.h"
+#include "as.h"
+#include "pte_scan.h"
 
 /* 2^20 pages ought to be enough for anybody */
 #define NPAGES	(1024*1024)
 
 static char* pages[NPAGES];
+static uint64_t nalloc;
+
+/* freed frames, reused (zeroed) before new ones are mapped */
+static uint64_t free_frames[NPAGES];
+static uint64_t nfree;
 
 uint64_t alloc_page_frame(void)
 {
-	static uint64_t nalloc;
 	uint64_t ppn;
 	void* va;
 
+	if (nfree > 0)
+		return free_frames[--nfree] + 0xbaaaaaad;
 	if (nalloc == NPAGES)
 		errx(1, "out of physical memory");
 
@@ -35,6 +44,16 @@ uint64_t alloc_page_frame(void)
 	return ppn + 0xbaaaaaad;
 }
 
+void free_page_frame(uint64_t ppn)
+{
+	ppn -= 0xbaaaaaad;
+	if (ppn >= nalloc)
+		errx(1, "freeing a frame that was never allocated");
+
+	memset(pages[ppn], 0, 1 << 13);
+	free_frames[nfree++] = ppn;
+}
+
 void* phys_to_virt(uint64_t phys_addr)
 {
 	uint64_t ppn = (phys_addr >> 13) - 0xbaaaaaad;
@@ -47,10 +66,8 @@ void* phys_to_virt(uint64_t phys_addr)
 	return va;
 }
 
-int main(int argc, char **argv)
+static void basic_test(uint64_t pt)
 {
-	uint64_t pt = alloc_page_frame();
-
 	assert(page_table_query(pt, 0xcafecafeeee) == NO_MAPPING);
 	assert(page_table_query(pt, 0xfffecafeeee) == NO_MAPPING);
 	assert(page_table_query(pt, 0xcafecafeeff) == NO_MAPPING);
@@ -62,7 +79,253 @@ int main(int argc, char **argv)
 	assert(page_table_query(pt, 0xcafecafeeee) == NO_MAPPING);
 	assert(page_table_query(pt, 0xfffecafeeee) == NO_MAPPING);
 	assert(page_table_query(pt, 0xcafecafeeff) == NO_MAPPING);
+}
 
-	return 0;
+static uint64_t rand_state = 88172645463325252ULL;
+
+static uint64_t rand64(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return rand_state;
 }
 
+#define NRANDOM	2000
+
+/* the same mappings in both layouts must give the same answers, with nodes growing, shrinking and merging */
+static void layout_test(void)
+{
+	static uint64_t vpns[NRANDOM];
+	uint64_t trie = page_table_create(PT_LAYOUT_TRIE);
+	uint64_t radix = page_table_create(PT_LAYOUT_RADIX);
+	uint64_t trie_frames, radix_frames;
+	int i;
+
+	assert(radix & PT_RADIX_TAG);
+	basic_test(radix);
+
+	/* sparse: isolated pages all over the address space, and pairs that differ only in the last level */
+	for (i = 0; i < NRANDOM; i++) {
+		vpns[i] = rand64() & ((1ULL << 45) - 1);
+		if (i % 4 == 1)
+			vpns[i] = vpns[i - 1] ^ (rand64() & 0x1ff);
+	}
+	trie_frames = nalloc - nfree;
+	for (i = 0; i < NRANDOM; i++)
+		page_table_update(trie, vpns[i], i);
+	trie_frames = nalloc - nfree - trie_frames;
+	radix_frames = nalloc - nfree;
+	for (i = 0; i < NRANDOM; i++)
+		page_table_update(radix, vpns[i], i);
+	radix_frames = nalloc - nfree - radix_frames;
+	assert(radix_frames * 20 < trie_frames);
+
+	/* dense: a run of 4096 pages fills full nodes at the last level */
+	for (i = 0; i < 4096; i++) {
+		page_table_update(trie, 0x123456789000ULL + i, 0x7000 + i);
+		page_table_update(radix, 0x123456789000ULL + i, 0x7000 + i);
+	}
+	for (i = 0; i < NRANDOM; i++) {
+		uint64_t probe = vpns[i] ^ (rand64() & 0x3ffff);
+		assert(page_table_query(radix, vpns[i]) == page_table_query(trie, vpns[i]));
+		assert(page_table_query(radix, probe) == page_table_query(trie, probe));
+	}
+	for (i = 0; i < 4096; i += 7)
+		assert(page_table_query(radix, 0x123456789000ULL + i) == 0x7000 + (uint64_t)i);
+
+	/* remove most of it, in an order unrelated to insertion */
+	for (i = 0; i < NRANDOM; i += 3) {
+		page_table_update(trie, vpns[i], NO_MAPPING);
+		page_table_update(radix, vpns[i], NO_MAPPING);
+	}
+	for (i = 0; i < 4096; i++) {
+		if (i % 100 == 0)
+			continue;
+		page_table_update(trie, 0x123456789000ULL + i, NO_MAPPING);
+		page_table_update(radix, 0x123456789000ULL + i, NO_MAPPING);
+	}
+	for (i = 0; i < NRANDOM; i++)
+		assert(page_table_query(radix, vpns[i]) == page_table_query(trie, vpns[i]));
+	for (i = 0; i < 4096; i++)
+		assert(page_table_query(radix, 0x123456789000ULL + i) == page_table_query(trie, 0x123456789000ULL + i));
+
+	/* and the rest: the table is empty again, and stays usable */
+	for (i = 0; i < NRANDOM; i++)
+		page_table_update(radix, vpns[i], NO_MAPPING);
+	for (i = 0; i < 4096; i += 100)
+		page_table_update(radix, 0x123456789000ULL + i, NO_MAPPING);
+	for (i = 0; i < NRANDOM; i++)
+		assert(page_table_query(radix, vpns[i]) == NO_MAPPING);
+	basic_test(radix);
+}
+
+#define NSPACES	1000
+
+/* more spaces than ASIDs, all mapping the same addresses differently, switched between round after round */
+static void as_test(void)
+{
+	static struct address_space* as[NSPACES];
+	uint64_t frames = nalloc - nfree;
+	struct as_stats stats;
+	uint64_t misses;
+	int i, round, k;
+
+	for (i = 0; i < NSPACES; i++) {
+		as[i] = as_create(i % 2 ? PT_LAYOUT_RADIX : PT_LAYOUT_TRIE);
+		assert(as[i]);
+		as_map(as[i], 0x1000, i);
+		for (k = 0; k < 8; k++)
+			as_map(as[i], 0x40000000ULL * i + k, 0x100000 + i * 8 + k);
+	}
+	assert(as_current() == NULL && as_translate(0x1000) == NO_MAPPING);
+
+	for (round = 0; round < 3; round++) {
+		for (i = 0; i < NSPACES; i++) {
+			as_switch(as[i]);
+			for (k = 0; k < 4; k++) {
+				assert(as_translate(0x1000) == (uint64_t)i);
+				assert(as_translate(0x40000000ULL * i + k) == 0x100000 + (uint64_t)i * 8 + k);
+			}
+			assert(as_translate(0x40000000ULL * i + 8) == NO_MAPPING);
+		}
+	}
+	as_get_stats(&stats);
+	assert(stats.rollovers > 0);
+
+	/* switching between a few spaces keeps their entries: after the first pass everything hits */
+	for (round = 0; round < 3; round++) {
+		if (round == 1)
+			as_get_stats(&stats);
+		for (i = 0; i < 4; i++) {
+			as_switch(as[i]);
+			assert(as_translate(0x1000) == (uint64_t)i);
+			assert(as_translate(0x40000000ULL * i + 3) == 0x100000 + (uint64_t)i * 8 + 3);
+		}
+	}
+	misses = stats.misses;
+	as_get_stats(&stats);
+	assert(stats.misses == misses);
+
+	/* a change in the table shows through the TLB, whether the space is current or not */
+	as_switch(as[7]);
+	assert(as_translate(0x1000) == 7);
+	as_map(as[7], 0x1000, 0xbeef);
+	assert(as_translate(0x1000) == 0xbeef);
+	as_switch(as[8]);
+	assert(as_translate(0x1000) == 8);
+	as_map(as[7], 0x1000, NO_MAPPING);
+	as_switch(as[7]);
+	assert(as_translate(0x1000) == NO_MAPPING);
+
+	/* teardown gives back every frame, and what's left keeps working */
+	for (i = 0; i < NSPACES; i += 2)
+		as_destroy(as[i]);
+	as_switch(as[9]);
+	assert(as_translate(0x1000) == 9);
+	as_destroy_all();
+	assert(as_current() == NULL);
+	assert(nalloc - nfree == frames);
+}
+
+/* every implementation agrees with the scalar one, at every alignment and length */
+static void scan_test(void)
+{
+	static const enum pte_scan_isa isas[] = {PTE_SCAN_SCALAR, PTE_SCAN_SSE2, PTE_SCAN_AVX2};
+	static uint64_t ptes[2 * 700], filled[2 * 600];
+	uint64_t entry[2] = {0x12345 << 13 | 1, 0xabcdef};
+	size_t expect_count[2][64], expect_find[2][64];
+	int stride, isa, i, n;
+
+	for (i = 0; i < 2 * 700; i++)
+		ptes[i] = rand64() % 23 == 0 ? rand64() | 1 : rand64() & ~1ULL;
+	pte_scan_select(PTE_SCAN_SCALAR);
+	for (stride = 1; stride <= 2; stride++)
+		for (n = 0; n < 64; n++) {
+			expect_count[stride - 1][n] = pte_count_valid(ptes + n * stride, 512 + n, stride);
+			expect_find[stride - 1][n] = pte_find_valid(ptes, n * 7, 512 + n, stride);
+		}
+
+	for (isa = 0; isa < 3; isa++) {
+		if (!pte_scan_select(isas[isa]))
+			continue;
+		for (stride = 1; stride <= 2; stride++) {
+			for (n = 0; n < 64; n++) {
+				assert(pte_count_valid(ptes + n * stride, 512 + n, stride) == expect_count[stride - 1][n]);
+				assert(pte_find_valid(ptes, n * 7, 512 + n, stride) == expect_find[stride - 1][n]);
+			}
+			pte_clear(filled, 600, stride);
+			assert(pte_find_valid(filled, 0, 600, stride) == 600 && pte_count_valid(filled, 600, stride) == 0);
+			pte_fill(filled + stride, 37 + isa, stride, entry);
+			assert(pte_find_valid(filled, 0, 600, stride) == 1);
+			assert(pte_count_valid(filled, 600, stride) == 37 + (size_t)isa);
+			assert(filled[stride * (37 + isa)] == entry[0] && filled[stride * (38 + isa)] == 0);
+			if (stride == 2)
+				assert(filled[2 * (37 + isa) + 1] == entry[1]);
+		}
+	}
+	if (!pte_scan_select(PTE_SCAN_AVX2))
+		pte_scan_select(PTE_SCAN_SSE2);
+}
+
+/* range scans, against a brute force over the mapped set, in both layouts */
+static void range_test(void)
+{
+	static uint64_t vpns[NRANDOM];
+	static char dup[NRANDOM];
+	uint64_t pts[2] = {page_table_create(PT_LAYOUT_TRIE), page_table_create(PT_LAYOUT_RADIX)};
+	uint64_t frames = nalloc - nfree;
+	int i, j, l;
+
+	for (l = 0; l < 2; l++) {
+		assert(page_table_next_mapped(pts[l], 0) == NO_MAPPING);
+		assert(page_table_count_range(pts[l], 0, ~0ULL) == 0);
+	}
+	/* clusters of nearby pages, so that ranges catch several */
+	for (i = 0; i < NRANDOM; i++) {
+		vpns[i] = i % 8 ? vpns[i - 1] + 1 + rand64() % 300 : rand64() & ((1ULL << 45) - 1);
+		vpns[i] &= (1ULL << 45) - 1;
+		for (l = 0; l < 2; l++)
+			page_table_update(pts[l], vpns[i], i);
+		for (j = 0; j < i && !dup[i]; j++)
+			dup[i] = vpns[j] == vpns[i];
+	}
+	for (i = 0; i < 500; i++) {
+		uint64_t start = vpns[rand64() % NRANDOM] - rand64() % 1000;
+		uint64_t end = start + rand64() % (i % 2 ? 5000 : 1ULL << (rand64() % 46));
+		uint64_t count = 0, next = NO_MAPPING;
+		for (j = 0; j < NRANDOM; j++) {
+			if (!dup[j] && vpns[j] >= start && vpns[j] < end)
+				count++;
+			if (vpns[j] >= start && vpns[j] < next)
+				next = vpns[j];
+		}
+		for (l = 0; l < 2; l++) {
+			assert(page_table_count_range(pts[l], start, end) == count);
+			assert(page_table_next_mapped(pts[l], start) == next);
+		}
+	}
+
+	/* unmapping everything frees the trie's nodes too */
+	for (i = 0; i < NRANDOM; i++)
+		for (l = 0; l < 2; l++)
+			page_table_update(pts[l], vpns[i], NO_MAPPING);
+	assert(nalloc - nfree == frames);
+	for (l = 0; l < 2; l++) {
+		assert(page_table_next_mapped(pts[l], 0) == NO_MAPPING);
+		page_table_destroy(pts[l]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t pt = alloc_page_frame();
+
+	basic_test(pt);
+	layout_test();
+	as_test();
+	scan_test();
+	range_test();
+
+	return 0;
+}
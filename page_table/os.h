@@ -4,9 +4,21 @@
 #define NO_MAPPING	(~0ULL)
 
 uint64_t alloc_page_frame(void);
+void free_page_frame(uint64_t ppn);
 void* phys_to_virt(uint64_t phys_addr);
 
+/* table layouts, see pt.c. A frame from alloc_page_frame() is an empty PT_LAYOUT_TRIE table */
+#define PT_LAYOUT_TRIE	0
+#define PT_LAYOUT_RADIX	1
+#define PT_RADIX_TAG	(1ULL << 63)	/* set in the pt of a radix table */
+
+uint64_t page_table_create(int layout);
 void page_table_update(uint64_t pt, uint64_t vpn, uint64_t ppn);
 uint64_t page_table_query(uint64_t pt, uint64_t vpn);
+/* number of mapped vpns in [start, end), and the first mapped vpn >= vpn (NO_MAPPING if there's none) */
+uint64_t page_table_count_range(uint64_t pt, uint64_t start, uint64_t end);
+uint64_t page_table_next_mapped(uint64_t pt, uint64_t vpn);
+/* free all frames of the table, the root included */
+void page_table_destroy(uint64_t pt);
 
 
@@ -0,0 +1,689 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "os.h"
+#include "pte_scan.h"
+
+/*
+ * A page table maps 45-bit virtual page numbers, split into 5 levels of 9 bits, to physical page numbers.
+ * A table is identified by the physical page number of its root frame, and comes in one of two layouts.
+ *
+ * The trie (PT_LAYOUT_TRIE, what a frame fresh from alloc_page_frame() is): a fixed 5-level walk through
+ * 512-entry nodes of 64-bit PTEs, one frame per node. Bit 0 of a PTE is the valid bit, the rest is the frame
+ * address (inner levels) or the mapped page's address (last level), ppn << 13 like phys_to_virt() expects.
+ *
+ * The radix table (PT_LAYOUT_RADIX, from page_table_create(), tagged with PT_RADIX_TAG) is meant for sparse
+ * address spaces, where the trie spends five frames on an isolated mapping:
+ *  - path compression: an entry can skip levels. It stores the vpn bits of the levels it skips and the level it
+ *    leads to, so an isolated mapping is a single entry in the root, pointing at the page itself.
+ *  - compact nodes: a node is sized to its population, 128 bytes for up to 7 entries, 1 KiB for up to 56 and a
+ *    full frame for up to 512. The small ones are carved out of frames by a chunk allocator.
+ * Nodes grow and shrink as entries come and go, and a node left with a single entry is merged into the entry
+ * pointing at it, so the tree stays as compressed as it was built. Queries give the same answers as the trie.
+ *
+ * Scans over whole nodes (range queries, finding what's left in a node, teardown) use the vectorized
+ * primitives of pte_scan.h.
+ */
+
+#define LEVELS		5
+#define LEVEL_BITS	9
+#define LEVEL_MASK	((1ULL << LEVEL_BITS) - 1)
+#define FRAME_SHIFT	13
+#define FRAME_SIZE	(1ULL << FRAME_SHIFT)
+#define PTE_VALID	1ULL
+
+/* bits of vpn's index at level (0 is the root) */
+static inline unsigned int level_index(uint64_t vpn, int level)
+{
+	return (vpn >> (LEVEL_BITS * (LEVELS - 1 - level))) & LEVEL_MASK;
+}
+
+/* the bits of levels [from, to) of vpn, as one number */
+static inline uint64_t vpn_bits(uint64_t vpn, int from, int to)
+{
+	if (from >= to)
+		return 0;
+	return (vpn >> (LEVEL_BITS * (LEVELS - to))) & ((1ULL << (LEVEL_BITS * (to - from))) - 1);
+}
+
+static inline void* frame_virt(uint64_t ppn)
+{
+	return phys_to_virt(ppn << FRAME_SHIFT);
+}
+
+/* ---------- trie ---------- */
+
+static inline int trie_node_empty(const uint64_t* node)
+{
+	return pte_find_valid(node, 0, LEVEL_MASK + 1, 1) == LEVEL_MASK + 1;
+}
+
+/* unmapping frees the nodes it leaves empty, the root excepted */
+static void trie_update(uint64_t pt, uint64_t vpn, uint64_t ppn)
+{
+	uint64_t* node = frame_virt(pt);
+	uint64_t* path[LEVELS - 1]; /* the PTE followed at each level */
+	int level;
+
+	for (level = 0; level < LEVELS - 1; level++) {
+		uint64_t* pte = &node[level_index(vpn, level)];
+		if (!(*pte & PTE_VALID)) {
+			if (ppn == NO_MAPPING)
+				return; /* nothing mapped below */
+			*pte = (alloc_page_frame() << FRAME_SHIFT) | PTE_VALID;
+		}
+		path[level] = pte;
+		node = phys_to_virt(*pte & ~PTE_VALID);
+	}
+	if (ppn != NO_MAPPING) {
+		node[level_index(vpn, LEVELS - 1)] = (ppn << FRAME_SHIFT) | PTE_VALID;
+		return;
+	}
+	node[level_index(vpn, LEVELS - 1)] = 0;
+	for (level = LEVELS - 2; level >= 0 && trie_node_empty(node); level--) {
+		free_page_frame(*path[level] >> FRAME_SHIFT);
+		*path[level] = 0;
+		node = level > 0 ? phys_to_virt(*path[level - 1] & ~PTE_VALID) : NULL;
+	}
+}
+
+static uint64_t trie_query(uint64_t pt, uint64_t vpn)
+{
+	uint64_t* node = frame_virt(pt);
+
+	for (int level = 0; level < LEVELS - 1; level++) {
+		uint64_t pte = node[level_index(vpn, level)];
+		if (!(pte & PTE_VALID))
+			return NO_MAPPING;
+		node = phys_to_virt(pte & ~PTE_VALID);
+	}
+	if (!(node[level_index(vpn, LEVELS - 1)] & PTE_VALID))
+		return NO_MAPPING;
+	return node[level_index(vpn, LEVELS - 1)] >> FRAME_SHIFT;
+}
+
+/* ---------- radix table ---------- */
+
+/*
+ * A radix entry is 16 bytes:
+ *   pte   bit 0 valid, bit 1 leaf.
+ *         leaf: the mapped ppn from bit 2.
+ *         otherwise: the physical address of the child node (128-byte aligned) | its class << 2.
+ *   meta  bits 0-3 the level the entry leads to (LEVELS for a leaf), bits 4-13 the child's entry count,
+ *         from bit 16 the vpn bits of the levels skipped between the entry's own level and that one.
+ */
+struct rentry {
+	uint64_t pte;
+	uint64_t meta;
+};
+
+#define RPTE_LEAF		2ULL
+#define RPTE_CLASS_SHIFT	2
+#define RPTE_ADDR_MASK		(~0x7fULL)
+#define RMETA_LEVEL_MASK	0xfULL
+#define RMETA_COUNT_SHIFT	4
+#define RMETA_COUNT_MASK	0x3ffULL
+#define RMETA_SKIP_SHIFT	16
+
+/*
+ * Node classes. Compact nodes keep their keys (level indices) sorted in a header, with the entries in the same
+ * order after it. Full nodes are a plain 512-entry array indexed by key, filling a frame.
+ */
+enum { NODE_SMALL, NODE_MEDIUM, NODE_FULL, NODE_CLASSES };
+
+static const struct node_class {
+	unsigned int size;
+	unsigned int capacity;
+	unsigned int entries; /* offset of the entries */
+	unsigned int shrink; /* move to the class below at this count */
+} node_classes[NODE_CLASSES] = {
+	[NODE_SMALL] = {128, 7, 16, 0},
+	[NODE_MEDIUM] = {1024, 56, 128, 3},
+	[NODE_FULL] = {FRAME_SIZE, 512, 0, 28},
+};
+
+static inline int entry_level(const struct rentry* e)
+{
+	return e->meta & RMETA_LEVEL_MASK;
+}
+
+static inline uint64_t entry_skip(const struct rentry* e)
+{
+	return e->meta >> RMETA_SKIP_SHIFT;
+}
+
+static inline unsigned int entry_count(const struct rentry* e)
+{
+	return (e->meta >> RMETA_COUNT_SHIFT) & RMETA_COUNT_MASK;
+}
+
+static inline int entry_class(const struct rentry* e)
+{
+	return (e->pte >> RPTE_CLASS_SHIFT) & 3;
+}
+
+static inline void* entry_node(const struct rentry* e)
+{
+	return phys_to_virt(e->pte & RPTE_ADDR_MASK);
+}
+
+static inline uint64_t make_meta(int level, unsigned int count, uint64_t skip)
+{
+	return (uint64_t)level | ((uint64_t)count << RMETA_COUNT_SHIFT) | (skip << RMETA_SKIP_SHIFT);
+}
+
+static inline void set_count(struct rentry* e, unsigned int count)
+{
+	e->meta = (e->meta & ~(RMETA_COUNT_MASK << RMETA_COUNT_SHIFT)) | ((uint64_t)count << RMETA_COUNT_SHIFT);
+}
+
+static inline struct rentry make_leaf(uint64_t ppn, int level, uint64_t vpn)
+{
+	struct rentry e = {(ppn << 2) | RPTE_LEAF | PTE_VALID, make_meta(LEVELS, 0, vpn_bits(vpn, level + 1, LEVELS))};
+	return e;
+}
+
+static inline uint16_t* node_keys(void* node)
+{
+	return node;
+}
+
+static inline struct rentry* node_entries(void* node, int cls)
+{
+	return (struct rentry*)((char*)node + node_classes[cls].entries);
+}
+
+/*
+ * Chunk allocator: small and medium nodes are chunks of slab frames. The first chunk of a slab frame is its
+ * header, keeping a list of the frame's free chunks (by offset, 0 ends it) and how many are in use. Frames with
+ * free chunks are on a doubly linked list per class. A frame whose chunks are all free goes back through
+ * free_page_frame(), so tearing a table down returns every frame no other table has a node in.
+ * Full nodes are whole frames.
+ */
+struct slab {
+	uint64_t prev, next; /* physical addresses of the neighbours on the class's partial list, 0 at the ends */
+	uint32_t free; /* offset of the first free chunk */
+	uint32_t inuse;
+};
+
+static uint64_t partial_slabs[NODE_CLASSES];
+
+static void slab_unlink(int cls, struct slab* slab)
+{
+	if (slab->prev)
+		((struct slab*)phys_to_virt(slab->prev))->next = slab->next;
+	else
+		partial_slabs[cls] = slab->next;
+	if (slab->next)
+		((struct slab*)phys_to_virt(slab->next))->prev = slab->prev;
+	slab->prev = slab->next = 0;
+}
+
+static void slab_push(int cls, uint64_t frame, struct slab* slab)
+{
+	slab->prev = 0;
+	slab->next = partial_slabs[cls];
+	if (slab->next)
+		((struct slab*)phys_to_virt(slab->next))->prev = frame;
+	partial_slabs[cls] = frame;
+}
+
+static uint64_t chunk_alloc(int cls)
+{
+	unsigned int size = node_classes[cls].size;
+	struct slab* slab;
+	uint64_t frame;
+
+	if (cls == NODE_FULL)
+		return alloc_page_frame() << FRAME_SHIFT;
+
+	if (!partial_slabs[cls]) {
+		frame = alloc_page_frame() << FRAME_SHIFT;
+		slab = phys_to_virt(frame);
+		for (uint32_t off = FRAME_SIZE - size; off > 0; off -= size) {
+			*(uint32_t*)((char*)slab + off) = slab->free;
+			slab->free = off;
+		}
+		slab_push(cls, frame, slab);
+	}
+	frame = partial_slabs[cls];
+	slab = phys_to_virt(frame);
+
+	uint32_t off = slab->free;
+	slab->free = *(uint32_t*)((char*)slab + off);
+	slab->inuse++;
+	if (!slab->free)
+		slab_unlink(cls, slab);
+	memset((char*)slab + off, 0, size);
+	return frame + off;
+}
+
+static void chunk_free(int cls, uint64_t phys)
+{
+	uint64_t frame = phys & ~(FRAME_SIZE - 1);
+	struct slab* slab = phys_to_virt(frame);
+	uint32_t off = phys - frame;
+
+	if (cls == NODE_FULL) {
+		free_page_frame(phys >> FRAME_SHIFT);
+		return;
+	}
+	if (!slab->free)
+		slab_push(cls, frame, slab);
+	*(uint32_t*)((char*)slab + off) = slab->free;
+	slab->free = off;
+	if (--slab->inuse == 0) {
+		slab_unlink(cls, slab);
+		free_page_frame(frame >> FRAME_SHIFT);
+	}
+}
+
+/* the entry for key in a node with count entries, NULL if there's none. *pos is where it is or would go */
+static struct rentry* node_find(void* node, int cls, unsigned int count, unsigned int key, unsigned int* pos)
+{
+	uint16_t* keys = node_keys(node);
+	unsigned int lo = 0, hi = count;
+
+	if (cls == NODE_FULL) {
+		struct rentry* e = &node_entries(node, cls)[key];
+		*pos = key;
+		return (e->pte & PTE_VALID) ? e : NULL;
+	}
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (keys[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*pos = lo;
+	return (lo < count && keys[lo] == key) ? &node_entries(node, cls)[lo] : NULL;
+}
+
+/* the first key >= key with an entry in a full node, 512 if there's none */
+static inline unsigned int full_next(const struct rentry* entries, unsigned int key)
+{
+	return pte_find_valid((const uint64_t*)entries, key, node_classes[NODE_FULL].capacity, 2);
+}
+
+/* copy the count entries of node (class from) into a new node of class to, and point parent at it */
+static void node_move(struct rentry* parent, void* node, int from, unsigned int count, int to)
+{
+	uint64_t phys = chunk_alloc(to);
+	void* dst = phys_to_virt(phys);
+	struct rentry* src_entries = node_entries(node, from);
+	struct rentry* dst_entries = node_entries(dst, to);
+	unsigned int n = 0;
+
+	if (from == NODE_FULL) {
+		for (unsigned int key = full_next(src_entries, 0); n < count; key = full_next(src_entries, key + 1)) {
+			node_keys(dst)[n] = key;
+			dst_entries[n++] = src_entries[key];
+		}
+	} else if (to == NODE_FULL) {
+		for (n = 0; n < count; n++)
+			dst_entries[node_keys(node)[n]] = src_entries[n];
+	} else {
+		memcpy(node_keys(dst), node_keys(node), count * sizeof(uint16_t));
+		memcpy(dst_entries, src_entries, count * sizeof(struct rentry));
+	}
+	chunk_free(from, parent->pte & RPTE_ADDR_MASK);
+	parent->pte = phys | ((uint64_t)to << RPTE_CLASS_SHIFT) | PTE_VALID;
+}
+
+/* add e under key to the node parent points at (the root if parent is NULL), growing the node if it's full */
+static void node_add(struct rentry* parent, void* node, unsigned int key, unsigned int pos, struct rentry e)
+{
+	int cls = parent ? entry_class(parent) : NODE_FULL;
+	unsigned int count = parent ? entry_count(parent) : 0;
+
+	if (parent && count == node_classes[cls].capacity) {
+		node_move(parent, node, cls, count, cls + 1);
+		cls++;
+		node = entry_node(parent);
+		node_find(node, cls, count, key, &pos);
+	}
+	if (cls == NODE_FULL) {
+		node_entries(node, cls)[key] = e;
+	} else {
+		uint16_t* keys = node_keys(node);
+		struct rentry* entries = node_entries(node, cls);
+		memmove(&keys[pos + 1], &keys[pos], (count - pos) * sizeof(uint16_t));
+		memmove(&entries[pos + 1], &entries[pos], (count - pos) * sizeof(struct rentry));
+		keys[pos] = key;
+		entries[pos] = e;
+	}
+	if (parent)
+		set_count(parent, count + 1);
+}
+
+/*
+ * remove the entry at pos from the node parent points at (the root if NULL). Then the node shrinks to a smaller
+ * class if it's sparse enough, or if a single entry is left, that entry takes the place of parent
+ */
+static void node_remove(struct rentry* parent, void* node, int level, unsigned int pos)
+{
+	int cls = parent ? entry_class(parent) : NODE_FULL;
+	unsigned int count = parent ? entry_count(parent) - 1 : 0;
+	struct rentry* entries = node_entries(node, cls);
+
+	if (cls == NODE_FULL) {
+		memset(&entries[pos], 0, sizeof(struct rentry));
+	} else {
+		uint16_t* keys = node_keys(node);
+		memmove(&keys[pos], &keys[pos + 1], (count - pos) * sizeof(uint16_t));
+		memmove(&entries[pos], &entries[pos + 1], (count - pos) * sizeof(struct rentry));
+	}
+	if (!parent)
+		return;
+
+	set_count(parent, count);
+	if (count == 1) {
+		/* parent skips to level, the remaining entry goes on from there: one entry skipping both */
+		unsigned int key;
+		struct rentry last;
+		if (cls == NODE_FULL) {
+			key = full_next(entries, 0);
+			last = entries[key];
+		} else {
+			key = node_keys(node)[0];
+			last = entries[0];
+		}
+		uint64_t skip = (entry_skip(parent) << LEVEL_BITS | key) << (LEVEL_BITS * (entry_level(&last) - level - 1));
+		chunk_free(cls, parent->pte & RPTE_ADDR_MASK);
+		parent->pte = last.pte;
+		parent->meta = make_meta(entry_level(&last), entry_count(&last), skip | entry_skip(&last));
+	} else if (count <= node_classes[cls].shrink) {
+		node_move(parent, node, cls, count, cls - 1);
+	}
+}
+
+static void radix_update(uint64_t pt, uint64_t vpn, uint64_t ppn)
+{
+	struct rentry* parent = NULL;
+	void* node = frame_virt(pt);
+	int cls = NODE_FULL, level = 0;
+
+	for (;;) {
+		unsigned int key = level_index(vpn, level), pos;
+		struct rentry* e = node_find(node, cls, parent ? entry_count(parent) : 0, key, &pos);
+
+		if (!e) {
+			if (ppn != NO_MAPPING)
+				node_add(parent, node, key, pos, make_leaf(ppn, level, vpn));
+			return;
+		}
+
+		int to = entry_level(e);
+		uint64_t skip = entry_skip(e);
+		if (vpn_bits(vpn, level + 1, to) == skip) {
+			if (e->pte & RPTE_LEAF) {
+				if (ppn == NO_MAPPING)
+					node_remove(parent, node, level, pos);
+				else
+					e->pte = (ppn << 2) | RPTE_LEAF | PTE_VALID;
+				return;
+			}
+			parent = e;
+			node = entry_node(e);
+			cls = entry_class(e);
+			level = to;
+			continue;
+		}
+		if (ppn == NO_MAPPING)
+			return;
+
+		/*
+		 * vpn leaves e's path at level split: a new node there holds e (skipping the rest) and the new leaf,
+		 * and e skips to it instead
+		 */
+		int split = level + 1;
+		while (vpn_bits(vpn, level + 1, split + 1) == skip >> (LEVEL_BITS * (to - split - 1)))
+			split++;
+
+		uint64_t phys = chunk_alloc(NODE_SMALL);
+		void* child = phys_to_virt(phys);
+		unsigned int old_key = (skip >> (LEVEL_BITS * (to - split - 1))) & LEVEL_MASK;
+		unsigned int new_key = level_index(vpn, split);
+		struct rentry old = *e;
+		struct rentry leaf = make_leaf(ppn, split, vpn);
+		unsigned int new_pos = new_key > old_key;
+
+		old.meta = make_meta(to, entry_count(e), skip & ((1ULL << (LEVEL_BITS * (to - split - 1))) - 1));
+		node_keys(child)[!new_pos] = old_key;
+		node_entries(child, NODE_SMALL)[!new_pos] = old;
+		node_keys(child)[new_pos] = new_key;
+		node_entries(child, NODE_SMALL)[new_pos] = leaf;
+
+		e->pte = phys | ((uint64_t)NODE_SMALL << RPTE_CLASS_SHIFT) | PTE_VALID;
+		e->meta = make_meta(split, 2, skip >> (LEVEL_BITS * (to - split)));
+		return;
+	}
+}
+
+static uint64_t radix_query(uint64_t pt, uint64_t vpn)
+{
+	void* node = frame_virt(pt);
+	int cls = NODE_FULL, level = 0;
+	unsigned int count = 0, pos;
+
+	for (;;) {
+		struct rentry* e = node_find(node, cls, count, level_index(vpn, level), &pos);
+		if (!e || vpn_bits(vpn, level + 1, entry_level(e)) != entry_skip(e))
+			return NO_MAPPING;
+		if (e->pte & RPTE_LEAF)
+			return e->pte >> 2;
+		node = entry_node(e);
+		cls = entry_class(e);
+		count = entry_count(e);
+		level = entry_level(e);
+	}
+}
+
+/* free the node e points at and everything below it */
+static void radix_free(const struct rentry* e)
+{
+	int cls = entry_class(e);
+	unsigned int count = entry_count(e);
+	struct rentry* entries;
+
+	if (e->pte & RPTE_LEAF)
+		return;
+	entries = node_entries(entry_node(e), cls);
+	if (cls == NODE_FULL) {
+		for (unsigned int key = full_next(entries, 0); key < node_classes[cls].capacity; key = full_next(entries, key + 1))
+			radix_free(&entries[key]);
+	} else {
+		for (unsigned int i = 0; i < count; i++)
+			radix_free(&entries[i]);
+	}
+	chunk_free(cls, e->pte & RPTE_ADDR_MASK);
+}
+
+static void radix_destroy(uint64_t pt)
+{
+	struct rentry* root = frame_virt(pt);
+
+	for (unsigned int key = full_next(root, 0); key < node_classes[NODE_FULL].capacity; key = full_next(root, key + 1))
+		radix_free(&root[key]);
+	free_page_frame(pt);
+}
+
+/* free the trie node in frame ppn at level and the nodes below it */
+static void trie_destroy(uint64_t ppn, int level)
+{
+	uint64_t* node = frame_virt(ppn);
+
+	if (level < LEVELS - 1) {
+		for (size_t i = pte_find_valid(node, 0, LEVEL_MASK + 1, 1); i <= LEVEL_MASK;
+		     i = pte_find_valid(node, i + 1, LEVEL_MASK + 1, 1))
+			trie_destroy(node[i] >> FRAME_SHIFT, level + 1);
+	}
+	free_page_frame(ppn);
+}
+
+/* ---------- range scans ---------- */
+
+/*
+ * The nodes below are visited in vpn order, jumping over empty entries with pte_find_valid(). A node at level
+ * covers the vpns from base on, its key k from base + (k << level_shift(level)).
+ */
+#define VPN_LIMIT	(1ULL << (LEVEL_BITS * LEVELS))
+
+static inline int level_shift(int level)
+{
+	return LEVEL_BITS * (LEVELS - 1 - level);
+}
+
+/* the keys of a node at level that cover [start, end), as [*first, *last). The node must overlap the range */
+static inline void key_range(int level, uint64_t base, uint64_t start, uint64_t end, unsigned int* first,
+			     unsigned int* last)
+{
+	uint64_t last_key = (end - 1 - base) >> level_shift(level);
+
+	*first = start > base ? (start - base) >> level_shift(level) : 0;
+	*last = last_key > LEVEL_MASK ? LEVEL_MASK + 1 : last_key + 1;
+}
+
+static uint64_t trie_count(const uint64_t* node, int level, uint64_t base, uint64_t start, uint64_t end)
+{
+	unsigned int first, last;
+	uint64_t count = 0;
+
+	key_range(level, base, start, end, &first, &last);
+	if (level == LEVELS - 1)
+		return pte_count_valid(node + first, last - first, 1);
+	for (size_t i = pte_find_valid(node, first, last, 1); i < last; i = pte_find_valid(node, i + 1, last, 1))
+		count += trie_count(phys_to_virt(node[i] & ~PTE_VALID), level + 1, base + (i << level_shift(level)),
+				    start, end);
+	return count;
+}
+
+static uint64_t trie_next(const uint64_t* node, int level, uint64_t base, uint64_t from)
+{
+	unsigned int first, last;
+
+	key_range(level, base, from, VPN_LIMIT, &first, &last);
+	for (size_t i = pte_find_valid(node, first, last, 1); i < last; i = pte_find_valid(node, i + 1, last, 1)) {
+		uint64_t vpn;
+		if (level == LEVELS - 1)
+			return base + i;
+		vpn = trie_next(phys_to_virt(node[i] & ~PTE_VALID), level + 1, base + (i << level_shift(level)), from);
+		if (vpn != NO_MAPPING)
+			return vpn;
+	}
+	return NO_MAPPING;
+}
+
+/* the position of the first entry with a key >= key, and its key (LEVEL_MASK + 1 if there's none) */
+static inline unsigned int radix_next_key(void* node, int cls, unsigned int count, unsigned int key,
+					  unsigned int* pos)
+{
+	if (cls == NODE_FULL)
+		return *pos = full_next(node_entries(node, cls), key);
+	node_find(node, cls, count, key, pos);
+	return *pos < count ? node_keys(node)[*pos] : LEVEL_MASK + 1;
+}
+
+/* the first vpn below e (an entry keyed key in a node at level covering from base), and how many it spans */
+static inline uint64_t entry_base(const struct rentry* e, int level, uint64_t base, unsigned int key, uint64_t* span)
+{
+	int shift = LEVEL_BITS * (LEVELS - entry_level(e));
+
+	*span = 1ULL << shift;
+	return base + ((uint64_t)key << level_shift(level)) + (entry_skip(e) << shift);
+}
+
+static uint64_t radix_count(void* node, int cls, unsigned int count, int level, uint64_t base, uint64_t start,
+			    uint64_t end)
+{
+	unsigned int first, last, pos, key;
+	uint64_t mapped = 0;
+
+	key_range(level, base, start, end, &first, &last);
+	if (level == LEVELS - 1 && cls == NODE_FULL) /* all leaves */
+		return pte_count_valid((const uint64_t*)&node_entries(node, cls)[first], last - first, 2);
+	for (key = radix_next_key(node, cls, count, first, &pos); key < last;
+	     key = radix_next_key(node, cls, count, key + 1, &pos)) {
+		struct rentry* e = &node_entries(node, cls)[pos];
+		uint64_t span, vpn = entry_base(e, level, base, key, &span);
+		if (vpn >= end || vpn + span <= start)
+			continue;
+		if (e->pte & RPTE_LEAF)
+			mapped++;
+		else
+			mapped += radix_count(entry_node(e), entry_class(e), entry_count(e), entry_level(e), vpn, start, end);
+	}
+	return mapped;
+}
+
+static uint64_t radix_next(void* node, int cls, unsigned int count, int level, uint64_t base, uint64_t from)
+{
+	unsigned int first, last, pos, key;
+
+	key_range(level, base, from, VPN_LIMIT, &first, &last);
+	for (key = radix_next_key(node, cls, count, first, &pos); key < last;
+	     key = radix_next_key(node, cls, count, key + 1, &pos)) {
+		struct rentry* e = &node_entries(node, cls)[pos];
+		uint64_t span, vpn = entry_base(e, level, base, key, &span);
+		if (vpn + span <= from)
+			continue;
+		if (e->pte & RPTE_LEAF)
+			return vpn;
+		vpn = radix_next(entry_node(e), entry_class(e), entry_count(e), entry_level(e), vpn, from);
+		if (vpn != NO_MAPPING)
+			return vpn;
+	}
+	return NO_MAPPING;
+}
+
+/* ---------- interface ---------- */
+
+uint64_t page_table_create(int layout)
+{
+	uint64_t pt = alloc_page_frame();
+	return layout == PT_LAYOUT_RADIX ? pt | PT_RADIX_TAG : pt;
+}
+
+void page_table_update(uint64_t pt, uint64_t vpn, uint64_t ppn)
+{
+	if (pt & PT_RADIX_TAG)
+		radix_update(pt & ~PT_RADIX_TAG, vpn, ppn);
+	else
+		trie_update(pt, vpn, ppn);
+}
+
+uint64_t page_table_query(uint64_t pt, uint64_t vpn)
+{
+	if (pt & PT_RADIX_TAG)
+		return radix_query(pt & ~PT_RADIX_TAG, vpn);
+	return trie_query(pt, vpn);
+}
+
+void page_table_destroy(uint64_t pt)
+{
+	if (pt & PT_RADIX_TAG)
+		radix_destroy(pt & ~PT_RADIX_TAG);
+	else
+		trie_destroy(pt, 0);
+}
+
+uint64_t page_table_count_range(uint64_t pt, uint64_t start, uint64_t end)
+{
+	if (end > VPN_LIMIT)
+		end = VPN_LIMIT;
+	if (start >= end)
+		return 0;
+	if (pt & PT_RADIX_TAG)
+		return radix_count(frame_virt(pt & ~PT_RADIX_TAG), NODE_FULL, 0, 0, 0, start, end);
+	return trie_count(frame_virt(pt), 0, 0, start, end);
+}
+
+uint64_t page_table_next_mapped(uint64_t pt, uint64_t vpn)
+{
+	if (vpn >= VPN_LIMIT)
+		return NO_MAPPING;
+	if (pt & PT_RADIX_TAG)
+		return radix_next(frame_virt(pt & ~PT_RADIX_TAG), NODE_FULL, 0, 0, 0, vpn);
+	return trie_next(frame_virt(pt), 0, 0, vpn);
+}
@@ -0,0 +1,233 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pte_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PTE_SCAN_X86
+#endif
+
+/*
+ * The vector versions work on words, not entries: a run of stride-word entries starts on a word index that's a
+ * multiple of stride, and so does every vector, so with stride 2 the entry's first word is always in the even
+ * lanes. A lane's valid bit is shifted up to its sign bit and collected with movemask, four vectors at a time,
+ * and counting adds the valid bits lane by lane. What doesn't fill a round of vectors is left to the scalar code.
+ */
+
+struct pte_scan_ops {
+	size_t (*find)(const uint64_t* ptes, size_t from, size_t n, int stride);
+	size_t (*count)(const uint64_t* ptes, size_t n, int stride);
+	void (*fill)(uint64_t* ptes, size_t n, int stride, const uint64_t* entry);
+};
+
+/* ---------- scalar ---------- */
+
+static size_t find_scalar(const uint64_t* ptes, size_t from, size_t n, int stride)
+{
+	for (size_t i = from; i < n; i++)
+		if (ptes[i * stride] & 1)
+			return i;
+	return n;
+}
+
+static size_t count_scalar(const uint64_t* ptes, size_t n, int stride)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < n; i++)
+		count += ptes[i * stride] & 1;
+	return count;
+}
+
+static void fill_scalar(uint64_t* ptes, size_t n, int stride, const uint64_t* entry)
+{
+	for (size_t i = 0; i < n; i++)
+		for (int w = 0; w < stride; w++)
+			ptes[i * stride + w] = entry[w];
+}
+
+static const struct pte_scan_ops scalar_ops = {find_scalar, count_scalar, fill_scalar};
+
+#ifdef PTE_SCAN_X86
+
+/* ---------- SSE2: 2 words per vector, 8 per round ---------- */
+
+__attribute__((target("sse2")))
+static inline int valid_sse2(const uint64_t* p)
+{
+	__m128i v = _mm_loadu_si128((const __m128i*)p);
+	return _mm_movemask_pd(_mm_castsi128_pd(_mm_slli_epi64(v, 63)));
+}
+
+__attribute__((target("sse2")))
+static size_t find_sse2(const uint64_t* ptes, size_t from, size_t n, int stride)
+{
+	size_t w = from * stride, end = n * stride;
+	unsigned int lanes = stride == 1 ? 0xff : 0x55;
+
+	for (; w + 8 <= end; w += 8) {
+		unsigned int m = valid_sse2(ptes + w) | valid_sse2(ptes + w + 2) << 2 |
+				 valid_sse2(ptes + w + 4) << 4 | valid_sse2(ptes + w + 6) << 6;
+		if (m & lanes)
+			return (w + __builtin_ctz(m & lanes)) / stride;
+	}
+	return find_scalar(ptes, w / stride, n, stride);
+}
+
+__attribute__((target("sse2")))
+static size_t count_sse2(const uint64_t* ptes, size_t n, int stride)
+{
+	size_t w = 0, end = n * stride;
+	__m128i bit = stride == 1 ? _mm_set1_epi64x(1) : _mm_set_epi64x(0, 1);
+	__m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+	uint64_t sum[2];
+
+	for (; w + 8 <= end; w += 8) {
+		__m128i v0 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(ptes + w)), bit);
+		__m128i v1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(ptes + w + 2)), bit);
+		__m128i v2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(ptes + w + 4)), bit);
+		__m128i v3 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(ptes + w + 6)), bit);
+		acc0 = _mm_add_epi64(acc0, _mm_add_epi64(v0, v1));
+		acc1 = _mm_add_epi64(acc1, _mm_add_epi64(v2, v3));
+	}
+	_mm_storeu_si128((__m128i*)sum, _mm_add_epi64(acc0, acc1));
+	return sum[0] + sum[1] + count_scalar(ptes + w, n - w / stride, stride);
+}
+
+__attribute__((target("sse2")))
+static void fill_sse2(uint64_t* ptes, size_t n, int stride, const uint64_t* entry)
+{
+	size_t w = 0, end = n * stride;
+	__m128i v = stride == 1 ? _mm_set1_epi64x(entry[0]) : _mm_set_epi64x(entry[1], entry[0]);
+
+	for (; w + 8 <= end; w += 8) {
+		_mm_storeu_si128((__m128i*)(ptes + w), v);
+		_mm_storeu_si128((__m128i*)(ptes + w + 2), v);
+		_mm_storeu_si128((__m128i*)(ptes + w + 4), v);
+		_mm_storeu_si128((__m128i*)(ptes + w + 6), v);
+	}
+	fill_scalar(ptes + w, n - w / stride, stride, entry);
+}
+
+static const struct pte_scan_ops sse2_ops = {find_sse2, count_sse2, fill_sse2};
+
+/* ---------- AVX2: 4 words per vector, 16 per round ---------- */
+
+__attribute__((target("avx2")))
+static inline int valid_avx2(const uint64_t* p)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i*)p);
+	return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(v, 63)));
+}
+
+__attribute__((target("avx2")))
+static size_t find_avx2(const uint64_t* ptes, size_t from, size_t n, int stride)
+{
+	size_t w = from * stride, end = n * stride;
+	unsigned int lanes = stride == 1 ? 0xffff : 0x5555;
+
+	for (; w + 16 <= end; w += 16) {
+		unsigned int m = valid_avx2(ptes + w) | valid_avx2(ptes + w + 4) << 4 |
+				 valid_avx2(ptes + w + 8) << 8 | valid_avx2(ptes + w + 12) << 12;
+		if (m & lanes)
+			return (w + __builtin_ctz(m & lanes)) / stride;
+	}
+	return find_scalar(ptes, w / stride, n, stride);
+}
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const uint64_t* ptes, size_t n, int stride)
+{
+	size_t w = 0, end = n * stride;
+	__m256i bit = stride == 1 ? _mm256_set1_epi64x(1) : _mm256_set_epi64x(0, 1, 0, 1);
+	__m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+	uint64_t sum[4];
+
+	for (; w + 16 <= end; w += 16) {
+		__m256i v0 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(ptes + w)), bit);
+		__m256i v1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(ptes + w + 4)), bit);
+		__m256i v2 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(ptes + w + 8)), bit);
+		__m256i v3 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(ptes + w + 12)), bit);
+		acc0 = _mm256_add_epi64(acc0, _mm256_add_epi64(v0, v1));
+		acc1 = _mm256_add_epi64(acc1, _mm256_add_epi64(v2, v3));
+	}
+	_mm256_storeu_si256((__m256i*)sum, _mm256_add_epi64(acc0, acc1));
+	return sum[0] + sum[1] + sum[2] + sum[3] + count_scalar(ptes + w, n - w / stride, stride);
+}
+
+__attribute__((target("avx2")))
+static void fill_avx2(uint64_t* ptes, size_t n, int stride, const uint64_t* entry)
+{
+	size_t w = 0, end = n * stride;
+	__m256i v = stride == 1 ? _mm256_set1_epi64x(entry[0]) :
+				  _mm256_set_epi64x(entry[1], entry[0], entry[1], entry[0]);
+
+	for (; w + 16 <= end; w += 16) {
+		_mm256_storeu_si256((__m256i*)(ptes + w), v);
+		_mm256_storeu_si256((__m256i*)(ptes + w + 4), v);
+		_mm256_storeu_si256((__m256i*)(ptes + w + 8), v);
+		_mm256_storeu_si256((__m256i*)(ptes + w + 12), v);
+	}
+	fill_scalar(ptes + w, n - w / stride, stride, entry);
+}
+
+static const struct pte_scan_ops avx2_ops = {find_avx2, count_avx2, fill_avx2};
+
+#endif /* PTE_SCAN_X86 */
+
+/* ---------- dispatch ---------- */
+
+static const struct pte_scan_ops* ops;
+
+int pte_scan_select(enum pte_scan_isa isa)
+{
+	switch (isa) {
+	case PTE_SCAN_SCALAR:
+		ops = &scalar_ops;
+		return 1;
+#ifdef PTE_SCAN_X86
+	case PTE_SCAN_SSE2:
+		if (!__builtin_cpu_supports("sse2"))
+			return 0;
+		ops = &sse2_ops;
+		return 1;
+	case PTE_SCAN_AVX2:
+		if (!__builtin_cpu_supports("avx2"))
+			return 0;
+		ops = &avx2_ops;
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+static inline const struct pte_scan_ops* scan_ops(void)
+{
+	if (!ops && !pte_scan_select(PTE_SCAN_AVX2) && !pte_scan_select(PTE_SCAN_SSE2))
+		pte_scan_select(PTE_SCAN_SCALAR);
+	return ops;
+}
+
+size_t pte_find_valid(const uint64_t* ptes, size_t from, size_t n, int stride)
+{
+	return from >= n ? n : scan_ops()->find(ptes, from, n, stride);
+}
+
+size_t pte_count_valid(const uint64_t* ptes, size_t n, int stride)
+{
+	return scan_ops()->count(ptes, n, stride);
+}
+
+void pte_fill(uint64_t* ptes, size_t n, int stride, const uint64_t* entry)
+{
+	scan_ops()->fill(ptes, n, stride, entry);
+}
+
+void pte_clear(uint64_t* ptes, size_t n, int stride)
+{
+	static const uint64_t zero[2];
+
+	scan_ops()->fill(ptes, n, stride, zero);
+}
@@ -0,0 +1,25 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bulk operations on page-table entries: runs of n entries of stride 64-bit words each (1 for trie PTEs, 2 for
+ * radix entries), valid when bit 0 of an entry's first word is set.
+ * There are SSE2 and AVX2 versions and a scalar one, picked at first use from what the CPU supports.
+ */
+
+enum pte_scan_isa {
+	PTE_SCAN_SCALAR,
+	PTE_SCAN_SSE2,
+	PTE_SCAN_AVX2,
+};
+
+/* index of the first valid entry in [from, n), n if there's none */
+size_t pte_find_valid(const uint64_t* ptes, size_t from, size_t n, int stride);
+/* number of valid entries in [0, n) */
+size_t pte_count_valid(const uint64_t* ptes, size_t n, int stride);
+/* set n entries to entry (stride words), or to 0 */
+void pte_fill(uint64_t* ptes, size_t n, int stride, const uint64_t* entry);
+void pte_clear(uint64_t* ptes, size_t n, int stride);
+
+/* use a given implementation from now on (for tests and benchmarks). 0 if the CPU doesn't have it */
+int pte_scan_select(enum pte_scan_isa isa);
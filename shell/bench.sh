@@ -0,0 +1,150 @@
+#!/bin/bash
+
+# Benchmarks for the shell's launch path and pipelines, next to /bin/sh as a baseline.
+# Usage: bench.sh [-n commands] [-s MB] [-j jobs] [shell]     (run from shell/, after building a.out)
+#
+#   commands/sec   a script of N one-word commands (/bin/true, never a builtin), run as a script file
+#   spawn latency  N commands fed one at a time on stdin, each timed from writing the line to reading its output
+#                  (/bin/echo, so that sh forks too instead of using its builtin echo)
+#   pipeline MB/s  S MB through 'cat < file | cat | ... | cat > file' (PIPE_STAGES), and through a single redirection
+#   background     J 'sleep 0.01 &' then wait, as jobs/sec
+#
+# Each workload runs REPEAT times per shell and the best run is reported.
+
+# === Configuration ===
+SHELL_EXEC="./a.out" # Path to the compiled shell executable
+BASELINE="/bin/sh"
+COMMANDS=2000
+SIZE_MB=256
+JOBS=500
+REPEAT=3
+PIPE_STAGES=8
+TEMP_DIR="shell_bench_temp_$$"
+
+while getopts "n:s:j:" opt; do
+    case $opt in
+        n) COMMANDS=$OPTARG ;;
+        s) SIZE_MB=$OPTARG ;;
+        j) JOBS=$OPTARG ;;
+        *) echo "Usage: $0 [-n commands] [-s MB] [-j jobs] [shell]" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ -n "$1" ] && SHELL_EXEC="$1"
+
+if [ ! -x "$SHELL_EXEC" ]; then
+    echo "$SHELL_EXEC not found, build it first: gcc -O2 -Wall -pthread shell.c myshell.c" >&2
+    exit 1
+fi
+
+cleanup() {
+    rm -rf "$TEMP_DIR"
+}
+trap cleanup EXIT SIGINT SIGTERM
+mkdir -p "$TEMP_DIR"
+
+# === Helper Functions ===
+
+# Times come from bash's EPOCHREALTIME with the dot removed: microseconds, without a process per sample.
+
+# best (shortest) wall time in microseconds of REPEAT runs of: shell script
+time_script() {
+    local shell="$1" script="$2" best=0 start end
+    for ((r = 0; r < REPEAT; r++)); do
+        start=${EPOCHREALTIME/./}
+        "$shell" "$script" > /dev/null 2>&1 < /dev/null
+        end=${EPOCHREALTIME/./}
+        if [ $best -eq 0 ] || [ $((end - start)) -lt $best ]; then
+            best=$((end - start))
+        fi
+    done
+    echo $best
+}
+
+# per-command latencies in microseconds, one per line, of N commands written one at a time to the shell's stdin
+spawn_latencies() {
+    local shell="$1" n="$2" line start end
+    coproc SH { exec "$shell" 2>/dev/null; }
+    for ((i = 0; i < n; i++)); do
+        start=${EPOCHREALTIME/./}
+        echo "/bin/echo $i" >&"${SH[1]}"
+        # myshell's prompt has no newline, so it shows up at the start of the output line
+        while read -r line <&"${SH[0]}"; do
+            [ "${line##* }" = "$i" ] && break
+        done
+        end=${EPOCHREALTIME/./}
+        echo $((end - start))
+    done
+    exec {SH[1]}>&-
+    wait "$SH_PID" 2>/dev/null
+}
+
+# p50 p90 p99 max of the numbers on stdin (nearest rank), in milliseconds
+percentiles() {
+    sort -n | awk '
+        function rank(q,  i) { i = int(NR * q); if (i < NR * q) i++; return v[i > 0 ? i : 1] / 1000 }
+        { v[NR] = $1 }
+        END { if (NR == 0) print "- - - -"; else printf "%.3f %.3f %.3f %.3f\n", rank(0.5), rank(0.9), rank(0.99), v[NR] / 1000 }'
+}
+
+# rate = count / (us / 1e6), printed with one decimal
+rate() {
+    awk -v count="$1" -v us="$2" 'BEGIN { printf "%.1f", (us > 0 ? count * 1e6 / us : 0) }'
+}
+
+row() {
+    printf "%-34s %14s %14s\n" "$1" "$2" "$3"
+}
+
+# === Workloads ===
+for ((i = 0; i < COMMANDS; i++)); do echo "/bin/true"; done > "$TEMP_DIR/commands.sh"
+
+{
+    for ((i = 0; i < JOBS; i++)); do echo "sleep 0.01 &"; done
+    echo "wait"
+} > "$TEMP_DIR/background.sh"
+
+head -c $((SIZE_MB * 1024 * 1024)) /dev/zero > "$TEMP_DIR/data"
+{
+    echo -n "cat < $TEMP_DIR/data"
+    for ((i = 1; i < PIPE_STAGES; i++)); do echo -n " | cat"; done
+    echo " > $TEMP_DIR/out"
+} > "$TEMP_DIR/pipeline.sh"
+echo "cat < $TEMP_DIR/data > $TEMP_DIR/out" > "$TEMP_DIR/redirect.sh"
+
+# === Run ===
+echo "==============================="
+echo "Shell benchmark: $SHELL_EXEC vs $BASELINE"
+echo "commands=$COMMANDS size=${SIZE_MB}MB jobs=$JOBS stages=$PIPE_STAGES repeat=$REPEAT"
+echo "==============================="
+row "" "$(basename "$SHELL_EXEC")" "$(basename "$BASELINE")"
+
+declare -A result
+for shell in "$SHELL_EXEC" "$BASELINE"; do
+    us=$(time_script "$shell" "$TEMP_DIR/commands.sh")
+    result[$shell,commands]=$(rate "$COMMANDS" "$us")
+
+    read -r p50 p90 p99 max < <(spawn_latencies "$shell" "$COMMANDS" | percentiles)
+    result[$shell,p50]=$p50
+    result[$shell,p90]=$p90
+    result[$shell,p99]=$p99
+    result[$shell,max]=$max
+
+    us=$(time_script "$shell" "$TEMP_DIR/pipeline.sh")
+    result[$shell,pipeline]=$(rate "$SIZE_MB" "$us")
+    us=$(time_script "$shell" "$TEMP_DIR/redirect.sh")
+    result[$shell,redirect]=$(rate "$SIZE_MB" "$us")
+
+    us=$(time_script "$shell" "$TEMP_DIR/background.sh")
+    result[$shell,background]=$(rate "$JOBS" "$us")
+done
+
+row "commands/sec" "${result[$SHELL_EXEC,commands]}" "${result[$BASELINE,commands]}"
+row "spawn latency p50 (ms)" "${result[$SHELL_EXEC,p50]}" "${result[$BASELINE,p50]}"
+row "spawn latency p90 (ms)" "${result[$SHELL_EXEC,p90]}" "${result[$BASELINE,p90]}"
+row "spawn latency p99 (ms)" "${result[$SHELL_EXEC,p99]}" "${result[$BASELINE,p99]}"
+row "spawn latency max (ms)" "${result[$SHELL_EXEC,max]}" "${result[$BASELINE,max]}"
+row "pipeline, $PIPE_STAGES stages (MB/s)" "${result[$SHELL_EXEC,pipeline]}" "${result[$BASELINE,pipeline]}"
+row "redirection (MB/s)" "${result[$SHELL_EXEC,redirect]}" "${result[$BASELINE,redirect]}"
+row "background jobs/sec" "${result[$SHELL_EXEC,background]}" "${result[$BASELINE,background]}"
+echo "==============================="
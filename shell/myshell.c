@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,290 +6,1783 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <sched.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
 
 #define READ_END 0
 #define WRITE_END 1
 
-// Reap children quickly to avoid zombies
-void reap_children(int sig) {
-    int errno_backup = errno; // for cases where the code was interrupted by a signal
-    // -1 tells waitpid() to wait for any child process, NULL because I'm not interested in the child's exit status
-    // and WNOHANG prevents waiting so we only check zombie (exited but not reaped yet) processes
-    while (waitpid(-1, NULL, WNOHANG) > 0) {}
-    if (errno != ECHILD && errno != EINTR && errno != 0) {
-        perror("waitpid in SIGCHLD");
-        exit(1);
+extern char **environ;
+
+// Children are started with posix_spawn (glibc implements it with clone(CLONE_VM|CLONE_VFORK), so the cost doesn't
+// grow with the shell's memory like fork's page table copy does). fork+execve is kept as a fallback for systems
+// without a usable posix_spawn, or when MYSHELL_FORK is set in the environment.
+static int use_fork;
+
+// ---------- jobs ----------
+// Every pipeline the shell starts is a job. Its children are watched through pidfds registered with one epoll
+// instance, so the shell learns which child exited without a SIGCHLD handler or polling, and reaps exactly that
+// child with wait4 to get its status and resource usage. Children are only ever reaped here.
+// Finished background jobs are announced before the next command when the shell is interactive; otherwise they stay
+// in the table (up to JOBS_KEEP_DONE of them) until jobs or wait reports them.
+// They're reaped as soon as they exit even while the shell waits for input: stdin is read through a stream that
+// waits for the epoll instance along with fd 0 (see stdin_read), so no zombie outlives its job at an idle prompt.
+#define JOBS_KEEP_DONE 1024
+#define EPOLL_BATCH 64
+#define JOBS_IDLE_POLL_MS 100
+
+struct job;
+
+// a child process, or a builtin stage running on a thread of the shell (see builtin stages below)
+struct job_proc {
+    struct job *job;
+    pid_t pid; // 0 for a thread
+    int pidfd; // -1 once reaped, or when pidfds aren't available.
+               // for a thread, the eventfd it signals when it's done
+    int watched; // pidfd is in the epoll set. if not, the proc is reaped with wait4/pthread_join directly
+    int done;
+    int is_thread;
+    pthread_t thread;
+    char *name; // argv[0]
+    int status;
+    struct rusage usage;
+    struct timespec finished;
+};
+
+struct job {
+    int id;
+    char *cmdline;
+    int background;
+    int nprocs;
+    int running;
+    int last; // index in procs of the pipeline's last stage, -1 if it didn't start
+    int status; // wait status of the last stage, like sh reports for a pipeline
+    struct rusage usage; // summed over the reaped stages (max for ru_maxrss)
+    int timed; // report its resource usage when it's done (time builtin)
+    struct timespec started;
+    struct timespec finished; // when the last process was reaped
+    struct job_proc *procs;
+    struct job *next;
+};
+
+static struct job *jobs_head, *jobs_tail; // in id order
+static int jobs_done; // finished background jobs still in the table
+static int epoll_fd = -1;
+static int interactive;
+
+static int open_pidfd(pid_t pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+// a job for up to nprocs children. NULL if out of memory
+static struct job *job_new(const char *cmdline, int nprocs, int background) {
+    struct job *job = calloc(1, sizeof(*job));
+    if (job == NULL || (job->procs = calloc(nprocs, sizeof(*job->procs))) == NULL ||
+        (job->cmdline = strdup(cmdline)) == NULL) {
+        if (job)
+            free(job->procs);
+        free(job);
+        return NULL;
+    }
+    job->id = jobs_tail ? jobs_tail->id + 1 : 1;
+    job->background = background;
+    job->last = nprocs - 1;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    if (jobs_tail)
+        jobs_tail->next = job;
+    else
+        jobs_head = job;
+    jobs_tail = job;
+    return job;
+}
+
+static void job_add_proc(struct job *job, pid_t pid, const char *name) {
+    struct job_proc *p = &job->procs[job->nprocs++];
+    p->job = job;
+    p->pid = pid;
+    p->name = strdup(name);
+    p->pidfd = epoll_fd != -1 ? open_pidfd(pid) : -1;
+    if (p->pidfd != -1) {
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = p};
+        p->watched = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p->pidfd, &ev) == 0;
+    }
+    job->running++;
+}
+
+static void job_add_thread(struct job *job, pthread_t thread, int done_fd, const char *name) {
+    struct job_proc *p = &job->procs[job->nprocs++];
+    p->job = job;
+    p->name = strdup(name);
+    p->is_thread = 1;
+    p->thread = thread;
+    p->pidfd = done_fd; // stays open until the thread is joined, it writes to it on the way out
+    if (epoll_fd != -1) {
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = p};
+        p->watched = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, done_fd, &ev) == 0;
+    }
+    job->running++;
+}
+
+// Closing a pidfd isn't enough to take it out of the epoll set: a child being spawned at that moment holds a copy
+// of the fd table until its exec, and epoll keeps reporting the registration as long as any copy is open
+static void proc_unwatch(struct job_proc *p) {
+    if (p->watched)
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, p->pidfd, NULL);
+    if (p->pidfd != -1)
+        close(p->pidfd);
+    p->pidfd = -1;
+    p->watched = 0;
+}
+
+static void job_remove(struct job *job) {
+    struct job **link = &jobs_head, *prev = NULL;
+    while (*link != job) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = job->next;
+    if (jobs_tail == job)
+        jobs_tail = prev;
+    if (job->background && job->running == 0)
+        jobs_done--;
+    for (int i = 0; i < job->nprocs; i++) {
+        proc_unwatch(&job->procs[i]);
+        free(job->procs[i].name);
+    }
+    free(job->procs);
+    free(job->cmdline);
+    free(job);
+}
+
+// ---------- accounting ----------
+// What a job cost, from the rusage wait4 returns for each of its processes: printed to stderr by the time builtin,
+// and with acct on, appended as one JSON object per line to the accounting log for every command:
+// {"job":N,"cmd":"...","status":S,"real":s,"user":s,"sys":s,"maxrss_kb":K,"nvcsw":N,"nivcsw":N,"inblock":N,
+//  "oublock":N,"minflt":N,"majflt":N,"stages":[{"name":"...","pid":P,"status":S,"real":s,...}, ...]}
+// status is the exit code, or 128 + the signal number like sh's $?. Builtins are logged with "builtin":true and the
+// shell's own usage while they ran (including children they reaped). Builtin stages have no usage of their own.
+static FILE *acct_log;
+static char *acct_path; // NULL when logging to stderr
+
+static double elapsed(const struct timespec *from, const struct timespec *to) {
+    return (double)(to->tv_sec - from->tv_sec) + (double)(to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static double tv_seconds(const struct timeval *tv) {
+    return (double)tv->tv_sec + (double)tv->tv_usec / 1e6;
+}
+
+static int exit_code(int status) {
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+static void rusage_add(struct rusage *sum, const struct rusage *ru) {
+    timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+    timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+    if (ru->ru_maxrss > sum->ru_maxrss)
+        sum->ru_maxrss = ru->ru_maxrss;
+    sum->ru_nvcsw += ru->ru_nvcsw;
+    sum->ru_nivcsw += ru->ru_nivcsw;
+    sum->ru_inblock += ru->ru_inblock;
+    sum->ru_oublock += ru->ru_oublock;
+    sum->ru_minflt += ru->ru_minflt;
+    sum->ru_majflt += ru->ru_majflt;
+}
+
+// after - before, for everything but ru_maxrss (kept from after)
+static void rusage_sub(struct rusage *after, const struct rusage *before) {
+    timersub(&after->ru_utime, &before->ru_utime, &after->ru_utime);
+    timersub(&after->ru_stime, &before->ru_stime, &after->ru_stime);
+    after->ru_nvcsw -= before->ru_nvcsw;
+    after->ru_nivcsw -= before->ru_nivcsw;
+    after->ru_inblock -= before->ru_inblock;
+    after->ru_oublock -= before->ru_oublock;
+    after->ru_minflt -= before->ru_minflt;
+    after->ru_majflt -= before->ru_majflt;
+}
+
+static void time_report(double real, const struct rusage *ru) {
+    fprintf(stderr, "real\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\n", real, tv_seconds(&ru->ru_utime),
+            tv_seconds(&ru->ru_stime));
+    fprintf(stderr, "maxrss %ld KiB, ctxsw %ld voluntary / %ld involuntary, io %ld in / %ld out blocks, "
+            "faults %ld minor / %ld major\n", ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw, ru->ru_inblock,
+            ru->ru_oublock, ru->ru_minflt, ru->ru_majflt);
+}
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
     }
-    errno = errno_backup;
+    fputc('"', f);
+}
+
+static void json_usage(FILE *f, double real, const struct rusage *ru) {
+    fprintf(f, "\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,"
+            "\"inblock\":%ld,\"oublock\":%ld,\"minflt\":%ld,\"majflt\":%ld", real, tv_seconds(&ru->ru_utime),
+            tv_seconds(&ru->ru_stime), ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw, ru->ru_inblock, ru->ru_oublock,
+            ru->ru_minflt, ru->ru_majflt);
+}
+
+static void acct_write_job(const struct job *job) {
+    fprintf(acct_log, "{\"job\":%d,\"cmd\":", job->id);
+    json_string(acct_log, job->cmdline);
+    fprintf(acct_log, ",\"status\":%d,", exit_code(job->status));
+    json_usage(acct_log, elapsed(&job->started, &job->finished), &job->usage);
+    fprintf(acct_log, ",\"stages\":[");
+    for (int i = 0; i < job->nprocs; i++) {
+        const struct job_proc *p = &job->procs[i];
+        fprintf(acct_log, "%s{\"name\":", i ? "," : "");
+        json_string(acct_log, p->name ? p->name : "");
+        fprintf(acct_log, ",\"pid\":%d,\"status\":%d,", (int)p->pid, exit_code(p->status));
+        json_usage(acct_log, elapsed(&job->started, &p->finished), &p->usage);
+        fprintf(acct_log, "}");
+    }
+    fprintf(acct_log, "]}\n");
+    fflush(acct_log);
+}
+
+static void acct_write_builtin(const char *cmdline, double real, const struct rusage *ru) {
+    fprintf(acct_log, "{\"cmd\":");
+    json_string(acct_log, cmdline);
+    fprintf(acct_log, ",\"builtin\":true,");
+    json_usage(acct_log, real, ru);
+    fprintf(acct_log, "}\n");
+    fflush(acct_log);
+}
+
+// called once, when the last process of a job has been reaped
+static void job_finished(struct job *job) {
+    if (job->timed)
+        time_report(elapsed(&job->started, &job->finished), &job->usage);
+    if (acct_log)
+        acct_write_job(job);
+}
+
+// acct on [file] | acct off: start (to file, or to stderr) or stop the accounting log. No argument: show the state
+int builtin_acct(int count, char **arglist) {
+    if (count == 1) {
+        if (acct_log)
+            printf("acct: on, %s\n", acct_path ? acct_path : "stderr");
+        else
+            printf("acct: off\n");
+        return 1;
+    }
+    if (strcmp(arglist[1], "on") != 0 && strcmp(arglist[1], "off") != 0) {
+        fprintf(stderr, "usage: acct on [file] | acct off\n");
+        return 1;
+    }
+    if (acct_log && acct_log != stderr)
+        fclose(acct_log);
+    free(acct_path);
+    acct_log = NULL;
+    acct_path = NULL;
+    if (strcmp(arglist[1], "off") == 0)
+        return 1;
+    if (count < 3) {
+        acct_log = stderr;
+    } else if ((acct_log = fopen(arglist[2], "ae")) == NULL || (acct_path = strdup(arglist[2])) == NULL) {
+        perror(arglist[2]);
+        if (acct_log)
+            fclose(acct_log);
+        acct_log = NULL;
+    }
+    return 1;
+}
+
+// reap p if it has exited (or wait for it without WNOHANG). returns 1 if it was reaped
+static int proc_reap(struct job_proc *p, int options) {
+    struct job *job = p->job;
+    struct rusage ru;
+    int status;
+    pid_t r;
+
+    if (p->done)
+        return 0;
+    if (p->is_thread) {
+        void *ret;
+        if ((options & WNOHANG) ? pthread_tryjoin_np(p->thread, &ret) != 0 : pthread_join(p->thread, &ret) != 0)
+            return 0;
+        status = ((int)(intptr_t)ret & 0xff) << 8; // as if it had called exit(ret)
+        memset(&ru, 0, sizeof(ru)); // its cost is the shell's own
+        r = 1;
+    } else {
+        while ((r = wait4(p->pid, &status, options, &ru)) == -1 && errno == EINTR) {}
+    }
+    if (r == 0)
+        return 0;
+    if (r == -1) { // not our child anymore, nothing to report
+        status = 0;
+        memset(&ru, 0, sizeof(ru));
+    }
+    proc_unwatch(p);
+    p->done = 1;
+    p->status = status;
+    p->usage = ru;
+    clock_gettime(CLOCK_MONOTONIC, &p->finished);
+    if (p - job->procs == job->last)
+        job->status = status;
+    rusage_add(&job->usage, &ru);
+    if (--job->running == 0) {
+        job->finished = p->finished;
+        if (job->background)
+            jobs_done++;
+        job_finished(job);
+    }
+    return 1;
+}
+
+// wait up to timeout ms (-1: until something happens) for children to exit, and reap the ones that did
+static void jobs_poll(int timeout) {
+    struct epoll_event events[EPOLL_BATCH];
+    int n = epoll_fd != -1 ? epoll_wait(epoll_fd, events, EPOLL_BATCH, timeout) : 0;
+    for (int i = 0; i < n; i++)
+        proc_reap(events[i].data.ptr, 0); // its pidfd is readable, wait4 won't block
+    // children without a pidfd
+    for (struct job *job = jobs_head; job; job = job->next) {
+        for (int i = 0; i < job->nprocs && job->running; i++) {
+            if (!job->procs[i].done && !job->procs[i].watched)
+                proc_reap(&job->procs[i], WNOHANG);
+        }
+    }
+}
+
+// a running proc of job that epoll won't report (no pidfd, or no epoll at all), NULL if there's none. waiting for
+// the job has to block in proc_reap on it, jobs_poll(-1) would sleep forever or spin
+static struct job_proc *job_unwatched(struct job *job) {
+    for (int i = 0; i < job->nprocs; i++) {
+        if (!job->procs[i].done && !job->procs[i].watched)
+            return &job->procs[i];
+    }
+    return NULL;
+}
+
+static void job_wait(struct job *job) {
+    while (job->running > 0) {
+        struct job_proc *p = job_unwatched(job);
+        if (p)
+            proc_reap(p, 0);
+        else
+            jobs_poll(-1);
+    }
+}
+
+static void job_print(const struct job *job) {
+    char state[64];
+    if (job->running > 0)
+        snprintf(state, sizeof(state), "Running");
+    else if (WIFSIGNALED(job->status))
+        snprintf(state, sizeof(state), "%s", strsignal(WTERMSIG(job->status)));
+    else if (WEXITSTATUS(job->status) != 0)
+        snprintf(state, sizeof(state), "Exit %d", WEXITSTATUS(job->status));
+    else
+        snprintf(state, sizeof(state), "Done");
+    printf("[%d] %-24s%s\n", job->id, state, job->cmdline);
+}
+
+// reap whatever has exited and report finished background jobs, called before each command
+static void jobs_notify(void) {
+    if (jobs_head == NULL) // nothing to reap, spare the syscall
+        return;
+    jobs_poll(0);
+    for (struct job *job = jobs_head, *next; job; job = next) {
+        next = job->next;
+        if (!job->background || job->running > 0)
+            continue;
+        if (interactive) {
+            job_print(job);
+            job_remove(job);
+        } else if (jobs_done > JOBS_KEEP_DONE) {
+            job_remove(job); // the oldest finished ones go first
+        }
+    }
+}
+
+// a running proc that epoll won't report, in any job
+static int jobs_unwatched(void) {
+    for (struct job *job = jobs_head; job; job = job->next) {
+        if (job_unwatched(job))
+            return 1;
+    }
+    return 0;
+}
+
+// read for the stdin stream (the shell's input lines, and parallel's): called only once the stream's buffer is
+// empty, when a read of fd 0 might block. Until fd 0 has something, reap whatever exits meanwhile. Procs epoll can't
+// report are checked every JOBS_IDLE_POLL_MS
+static ssize_t stdin_read(void *cookie, char *buf, size_t size) {
+    ssize_t n;
+    (void)cookie;
+
+    while (jobs_head) {
+        struct pollfd fds[2] = {{.fd = STDIN_FILENO, .events = POLLIN}, {.fd = epoll_fd, .events = POLLIN}};
+        n = poll(fds, epoll_fd != -1 ? 2 : 1, jobs_unwatched() ? JOBS_IDLE_POLL_MS : -1);
+        if (n == -1 && errno != EINTR)
+            break;
+        if (n > 0 && fds[0].revents) // input, EOF or an error, read tells which
+            break;
+        jobs_poll(0);
+    }
+    while ((n = read(STDIN_FILENO, buf, size)) == -1 && errno == EINTR) {}
+    return n;
+}
+
+static int jobs_init(void) {
+    FILE *in = fopencookie(NULL, "r", (cookie_io_functions_t){.read = stdin_read});
+
+    interactive = isatty(STDIN_FILENO);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+        perror("epoll_create1"); // not fatal, children are then reaped with blocking waits
+    if (in == NULL) {
+        perror("fopencookie");
+        return -1;
+    }
+    stdin = in; // nothing was read from the old one yet
+    return 0;
+}
+
+static void jobs_free(void) {
+    while (jobs_head)
+        job_remove(jobs_head);
+    if (epoll_fd != -1)
+        close(epoll_fd);
+    epoll_fd = -1;
+}
+
+// "%N" or a pid of one of the job's processes
+static struct job *job_find(const char *spec) {
+    char *end;
+    long n = strtol(spec[0] == '%' ? spec + 1 : spec, &end, 10);
+    if (*end != '\0' || end == spec)
+        return NULL;
+    for (struct job *job = jobs_head; job; job = job->next) {
+        if (spec[0] == '%' && job->id == n)
+            return job;
+        for (int i = 0; spec[0] != '%' && i < job->nprocs; i++) {
+            if (!job->procs[i].is_thread && job->procs[i].pid == n)
+                return job;
+        }
+    }
+    return NULL;
+}
+
+// jobs [-l]: list background jobs (-l adds pids and, for finished ones, cpu time). finished jobs are forgotten
+int builtin_jobs(int count, char **arglist) {
+    int long_format = count > 1 && strcmp(arglist[1], "-l") == 0;
+    jobs_poll(0);
+    for (struct job *job = jobs_head, *next; job; job = next) {
+        next = job->next;
+        if (!job->background)
+            continue;
+        job_print(job);
+        if (long_format) {
+            printf("     pids:");
+            for (int i = 0; i < job->nprocs; i++)
+                job->procs[i].is_thread ? printf(" -") : printf(" %d", (int)job->procs[i].pid);
+            if (job->running == 0)
+                printf("  user %ld.%03lds sys %ld.%03lds", (long)job->usage.ru_utime.tv_sec,
+                       (long)job->usage.ru_utime.tv_usec / 1000, (long)job->usage.ru_stime.tv_sec,
+                       (long)job->usage.ru_stime.tv_usec / 1000);
+            printf("\n");
+        }
+        if (job->running == 0)
+            job_remove(job);
+    }
+    return 1;
+}
+
+// wait [%N|pid]...: wait for the given background jobs, all of them without arguments
+int builtin_wait(int count, char **arglist) {
+    if (count == 1) {
+        for (struct job *job = jobs_head, *next; job; job = next) {
+            next = job->next;
+            if (job->background) {
+                job_wait(job);
+                job_remove(job);
+            }
+        }
+        return 1;
+    }
+    for (int i = 1; i < count; i++) {
+        struct job *job = job_find(arglist[i]);
+        if (job == NULL || !job->background) {
+            fprintf(stderr, "wait: %s: no such job\n", arglist[i]);
+            continue;
+        }
+        job_wait(job);
+        if (WIFEXITED(job->status) && WEXITSTATUS(job->status) != 0)
+            fprintf(stderr, "wait: %s: exit %d\n", arglist[i], WEXITSTATUS(job->status));
+        else if (WIFSIGNALED(job->status))
+            fprintf(stderr, "wait: %s: %s\n", arglist[i], strsignal(WTERMSIG(job->status)));
+        job_remove(job);
+    }
+    return 1;
+}
+
+// fg [%N]: wait for a background job (the newest by default) as if it ran in the foreground. Its processes were
+// started ignoring SIGINT and the shell doesn't use process groups, so unlike in job-control shells Ctrl+C still
+// doesn't reach it
+int builtin_fg(int count, char **arglist) {
+    struct job *job = NULL;
+    if (count > 1) {
+        job = job_find(arglist[1]);
+    } else {
+        for (struct job *j = jobs_head; j; j = j->next) {
+            if (j->background)
+                job = j;
+        }
+    }
+    if (job == NULL || !job->background) {
+        fprintf(stderr, "fg: %s: no such job\n", count > 1 ? arglist[1] : "current");
+        return 1;
+    }
+    printf("%s\n", job->cmdline);
+    fflush(stdout);
+    job_wait(job);
+    job_remove(job);
+    return 1;
 }
 
 // Ignore SIGINT in the shell, but restore it in child processes
 // This is because by default, Ctrl+C would kill the shell but I want only child processes to die on Ctrl+C — not the shell.
 int prepare(void) {
+    use_fork = getenv("MYSHELL_FORK") != NULL;
+
     // Ignore Ctrl-C in the shell itself
     if (signal(SIGINT, SIG_IGN) == SIG_ERR) {
         perror("signal(SIGINT)");
         return -1;
     }
 
-    // Set a SIGCHLD handler that reaps terminated children
-    struct sigaction sa;
-    sa.sa_handler = reap_children;
-    // SA_RESTART ensures that waitpid() is restarted if interrupted by a signal like SIGCHLD.
-    // avoids EINTR errors and reduces the need for extra checks.
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    if (sigaction(SIGCHLD, &sa, NULL) == -1) { // register reap_children() as the handler for SIGCHLD
-        perror("sigaction(SIGCHLD)");
+    // Children are reaped by the job table. SIGCHLD must not be left ignored by whoever started us, or the kernel
+    // would reap them itself and their status would be lost
+    if (signal(SIGCHLD, SIG_DFL) == SIG_ERR) {
+        perror("signal(SIGCHLD)");
         return -1;
     }
-    return 0;
+    return jobs_init();
 }
 
-int finalize(void) {
-    return 0;
+// ---------- command hash ----------
+// Like other shells, remember where each command name was found in PATH, so running it again is a single execve
+// instead of one failing attempt per PATH directory in front of it. The table is dropped whenever PATH differs from
+// the value it was built with, and an entry is dropped when its file turns out to be gone (ENOENT).
+#define CMD_HASH_BUCKETS 64
+
+struct cmd_hash {
+    char *name;
+    char *path;
+    unsigned long hits;
+    struct cmd_hash *next;
+};
+
+static struct cmd_hash *cmd_table[CMD_HASH_BUCKETS];
+static char *cmd_table_path; // PATH the table was built with, NULL for unset
+
+static unsigned int cmd_hash_bucket(const char *name) {
+    unsigned int h = 2166136261u; // FNV-1a
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h % CMD_HASH_BUCKETS;
 }
 
-// helper func: find index of symbol in arglist
-int find_symbol(char **arglist, int count, const char *symbol) {
-    for (int i = 0; i < count; i++) {
-        if (strcmp(arglist[i], symbol) == 0)
-            return i;
+static void cmd_hash_clear(void) {
+    for (int i = 0; i < CMD_HASH_BUCKETS; i++) {
+        while (cmd_table[i]) {
+            struct cmd_hash *e = cmd_table[i];
+            cmd_table[i] = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+        }
     }
-    return -1;
 }
 
-// helper func: set up redirection
-void redirect(int fd, int target_fd) {
-    if (dup2(fd, target_fd) == -1) {
-        perror("dup2");
-        exit(1);
+static struct cmd_hash **cmd_hash_find(const char *name) {
+    struct cmd_hash **link = &cmd_table[cmd_hash_bucket(name)];
+    while (*link && strcmp((*link)->name, name) != 0)
+        link = &(*link)->next;
+    return link;
+}
+
+static void cmd_hash_forget(const char *name) {
+    struct cmd_hash **link = cmd_hash_find(name), *e = *link;
+    if (e) {
+        *link = e->next;
+        free(e->name);
+        free(e->path);
+        free(e);
     }
-    close(fd);
 }
 
-int handle_input_redirection(char **arglist, int count) {
-    int input_idx = find_symbol(arglist, count, "<");
-    if (input_idx != -1) {
-        // I expect a filename after the < so if < is the last argument it’s invalid
-        if (input_idx + 1 >= count) {
-            fprintf(stderr, "Missing input file\n");
-            return 1;
+// search PATH the way execvp does: an empty element is the current directory, a file that exists but can't be
+// executed only matters if nothing later in PATH can. returns a malloc'ed path or NULL with *err set
+static char *cmd_search(const char *name, const char *path_var, int *err) {
+    size_t name_len = strlen(name);
+    *err = ENOENT;
+    for (const char *dir = path_var;; dir++) {
+        const char *end = strchrnul(dir, ':');
+        size_t dir_len = end - dir;
+        char *candidate = malloc(dir_len + name_len + 2);
+        struct stat st;
+        if (candidate == NULL) {
+            *err = ENOMEM;
+            return NULL;
         }
+        if (dir_len == 0) {
+            memcpy(candidate, name, name_len + 1);
+        } else {
+            memcpy(candidate, dir, dir_len);
+            candidate[dir_len] = '/';
+            memcpy(candidate + dir_len + 1, name, name_len + 1);
+        }
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode)) {
+            if (access(candidate, X_OK) == 0)
+                return candidate;
+            *err = EACCES;
+        }
+        free(candidate);
+        if (*end == '\0')
+            return NULL;
+        dir = end;
+    }
+}
+
+// resolve a command name to the path to execute. names with a '/' are used as they are.
+// returns NULL with *err set if there is nothing to run
+static const char *cmd_path(const char *name, int *err) {
+    const char *path_var = getenv("PATH");
+    struct cmd_hash **link, *e;
+    char *path;
+
+    if (strchr(name, '/'))
+        return name;
+    if (path_var == NULL)
+        path_var = "/bin:/usr/bin"; // what execvp uses
+    if (cmd_table_path == NULL || strcmp(cmd_table_path, path_var) != 0) {
+        cmd_hash_clear();
+        free(cmd_table_path);
+        cmd_table_path = strdup(path_var);
+    }
+
+    link = cmd_hash_find(name);
+    if (*link) {
+        (*link)->hits++;
+        return (*link)->path;
+    }
+    if ((path = cmd_search(name, path_var, err)) == NULL)
+        return NULL;
+    if ((e = malloc(sizeof(*e))) == NULL || (e->name = strdup(name)) == NULL) {
+        free(e);
+        free(path);
+        *err = ENOMEM;
+        return NULL;
+    }
+    e->path = path;
+    e->hits = 1;
+    e->next = NULL;
+    *link = e;
+    return path;
+}
 
-        pid_t pid = fork();
-        if (pid == 0) {
-            // Open the input file (the one after <) for reading.
-            int fd = open(arglist[input_idx + 1], O_RDONLY);
-            if (fd == -1) {
-                perror("open input");
-                exit(1);
+// hash: list the table. hash -r: empty it. hash name...: look the names up without running them
+int builtin_hash(int count, char **arglist) {
+    int err;
+    if (count == 1) {
+        int empty = 1;
+        for (int i = 0; i < CMD_HASH_BUCKETS; i++) {
+            for (struct cmd_hash *e = cmd_table[i]; e; e = e->next) {
+                if (empty)
+                    printf("hits\tcommand\n");
+                empty = 0;
+                printf("%4lu\t%s\n", e->hits, e->path);
             }
-            // now when the program tries to read from standard input it's actually reading from the file instead
-            redirect(fd, STDIN_FILENO); 
-            // Set < to NULL so execvp() only sees the actual command (not < or file)
-            arglist[input_idx] = NULL;
-            execvp(arglist[0], arglist);
-            // If execvp() is successful, it won't return at all, otherwise there's an error
-            perror("execvp");
-            exit(1);
-        } else if (pid > 0) {
-            waitpid(pid, NULL, 0);
-        } else {
-            perror("fork");
-            return 1;
         }
+        if (empty)
+            printf("hash: hash table empty\n");
+        return 1;
+    }
+    if (strcmp(arglist[1], "-r") == 0) {
+        cmd_hash_clear();
         return 1;
     }
+    for (int i = 1; i < count; i++) {
+        if (strchr(arglist[i], '/'))
+            continue;
+        if (cmd_path(arglist[i], &err) == NULL)
+            fprintf(stderr, "hash: %s: not found\n", arglist[i]);
+        else
+            (*cmd_hash_find(arglist[i]))->hits = 0; // looked up, not run
+    }
+    return 1;
+}
+
+int finalize(void) {
+    jobs_free();
+    if (acct_log && acct_log != stderr)
+        fclose(acct_log);
+    free(acct_path);
+    cmd_hash_clear();
+    free(cmd_table_path);
     return 0;
 }
 
+// What a child gets besides its argv: the fds to install as its stdin/stdout (-1 keeps the shell's) and whether
+// SIGINT goes back to default (foreground) or stays ignored as in the shell (background).
+// The fds must be O_CLOEXEC so that no child keeps a copy it wasn't given explicitly.
+struct launch {
+    char **argv;
+    int in_fd;
+    int out_fd;
+    int sigint_default;
+};
 
-int handle_output_redirection(char **arglist, int count) {
-    int output_idx = find_symbol(arglist, count, ">");
-    if (output_idx != -1) {
-        if (output_idx + 1 >= count) {
-            fprintf(stderr, "Missing output file\n");
-            return 1;
+// returns 0 or the error number. a failing exec is reported here too, glibc's posix_spawn waits for it
+static int launch_spawn(const struct launch *l, const char *path, pid_t *pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigdefault;
+    int err;
+
+    if ((err = posix_spawn_file_actions_init(&actions)) != 0)
+        return err;
+    if ((err = posix_spawnattr_init(&attr)) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
+    }
+    // dup2 clears O_CLOEXEC on the copy, the original is closed by the exec
+    if (l->in_fd != -1)
+        err = posix_spawn_file_actions_adddup2(&actions, l->in_fd, STDIN_FILENO);
+    if (!err && l->out_fd != -1)
+        err = posix_spawn_file_actions_adddup2(&actions, l->out_fd, STDOUT_FILENO);
+    if (!err && l->sigint_default) {
+        sigemptyset(&sigdefault);
+        sigaddset(&sigdefault, SIGINT);
+        err = posix_spawnattr_setsigdefault(&attr, &sigdefault);
+        if (!err)
+            err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+    }
+    if (!err)
+        err = posix_spawn(pid, path, &actions, &attr, l->argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
+}
+
+// argv for running path, a file that isn't a binary or a #! script, as a shell script like execvp would:
+// /bin/sh path args... NULL if out of memory
+static char **script_argv(const struct launch *l, const char *path) {
+    int argc = 0;
+    char **argv;
+
+    while (l->argv[argc])
+        argc++;
+    if ((argv = malloc(sizeof(char *) * (argc + 2))) == NULL)
+        return NULL;
+    argv[0] = "/bin/sh";
+    argv[1] = (char *)path;
+    memcpy(&argv[2], &l->argv[1], sizeof(char *) * argc); // args and the NULL
+    return argv;
+}
+
+// the same contract as launch_spawn: the child sends execve's errno back on an O_CLOEXEC pipe, which an exec that
+// works closes empty. A child that couldn't exec is reaped here, it never was a command.
+// Between fork and exec only async-signal-safe calls: builtin stages may be running on other threads
+static int launch_fork(const struct launch *l, const char *path, pid_t *pid) {
+    int errpipe[2], err = 0;
+    ssize_t n;
+
+    if (pipe2(errpipe, O_CLOEXEC) == -1)
+        return errno;
+    if ((*pid = fork()) == 0) {
+        close(errpipe[READ_END]);
+        if (l->sigint_default)
+            signal(SIGINT, SIG_DFL); // restore Ctrl+C for foreground children
+        if ((l->in_fd == -1 || dup2(l->in_fd, STDIN_FILENO) != -1) &&
+            (l->out_fd == -1 || dup2(l->out_fd, STDOUT_FILENO) != -1))
+            execve(path, l->argv, environ);
+        // If execve() is successful, it won't return at all, otherwise there's an error
+        err = errno;
+        write(errpipe[WRITE_END], &err, sizeof(err));
+        _exit(127);
+    }
+    if (*pid == -1)
+        err = errno;
+    close(errpipe[WRITE_END]);
+    if (*pid > 0) {
+        while ((n = read(errpipe[READ_END], &err, sizeof(err))) == -1 && errno == EINTR) {}
+        if (n != sizeof(err))
+            err = 0;
+        else
+            while (waitpid(*pid, NULL, 0) == -1 && errno == EINTR) {}
+    }
+    close(errpipe[READ_END]);
+    return err;
+}
+
+// posix_spawn, or fork and exec where there's no posix_spawn (or MYSHELL_FORK is set)
+static int launch_start(const struct launch *l, const char *path, pid_t *pid) {
+    int err;
+    if (!use_fork && (err = launch_spawn(l, path, pid)) != ENOSYS)
+        return err;
+    use_fork = 1; // no posix_spawn here, stop trying
+    return launch_fork(l, path, pid);
+}
+
+// start a child as described by l. returns its pid, or -1 after printing why it couldn't be started
+pid_t launch(const struct launch *l) {
+    pid_t pid;
+    int err;
+    const char *path = cmd_path(l->argv[0], &err);
+
+    if (path == NULL) {
+        fprintf(stderr, "execvp: %s\n", strerror(err));
+        return -1;
+    }
+    err = launch_start(l, path, &pid);
+    if (err == ENOENT && path != l->argv[0]) {
+        // the hashed file is gone, look for the command in PATH again
+        cmd_hash_forget(l->argv[0]);
+        if ((path = cmd_path(l->argv[0], &err)) != NULL)
+            err = launch_start(l, path, &pid);
+    }
+    if (err == ENOEXEC) {
+        struct launch script = *l;
+        if ((script.argv = script_argv(l, path)) != NULL) {
+            err = launch_start(&script, script.argv[0], &pid);
+            free(script.argv);
         }
+    }
+    if (err != 0) {
+        fprintf(stderr, "execvp: %s\n", strerror(err));
+        return -1;
+    }
+    return pid;
+}
 
-        pid_t pid = fork();
-        if (pid == 0) {
-            // open the output file for writing, create or truncate it
-            int fd = open(arglist[output_idx + 1], O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-            if (fd == -1) {
-                perror("open output");
-                exit(1);
-            }
-            // redirect stdout to the file
-            redirect(fd, STDOUT_FILENO);
-            arglist[output_idx] = NULL;
-            execvp(arglist[0], arglist);
-            perror("execvp");
-            exit(1);
-        } else if (pid > 0) {
-            waitpid(pid, NULL, 0);
-        } else {
-            perror("fork");
-            return 1;
+// ---------- builtin stages ----------
+// fcat [file...] and ftee [file...] work like cat and tee, but run as a thread of the shell instead of a process
+// and move data inside the kernel: splice between pipes and files, tee(2) to duplicate a pipe's contents,
+// copy_file_range between files, sendfile from a file to anything else. User-space copies are only the fallback
+// for the combinations none of those support (e.g. a terminal on both sides).
+// They can be any stage of a pipeline. Their status is an exit code like a command's, 1 on errors.
+#define MOVE_CHUNK (1 << 20)
+
+struct builtin_stage {
+    int (*run)(struct builtin_stage *bs);
+    char **argv;  // a copy, the thread can outlive the arglist (background jobs)
+    int in_fd;    // owned by the thread and closed when it's done, so the next stage sees EOF
+    int out_fd;
+    int done_fd;  // eventfd written when run returns
+};
+
+// pipe size for pipelines created from now on, 0 for the kernel default. set by the pipesize builtin
+static int pipe_size;
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
         }
-        return 1;
+        buf += n;
+        len -= n;
     }
     return 0;
 }
 
-int handle_pipes(char **arglist, int count) {
-    int pipes_counter = 0;
-    for (int i = 0; i < count; i++) {
-        if (strcmp(arglist[i], "|") == 0)
-            pipes_counter++;
-    }
-
-    if (pipes_counter > 0) {
-        int num_cmds = pipes_counter + 1;
-        // Breaks arglist into separate null terminated command arrays by replacing | with NULLx
-        char **commands[10]; // 10 commands max
-        int cmd_idx = 0;
-        
-        commands[cmd_idx] = arglist; // First command
-        cmd_idx++;
-        
-        for (int i = 0; i < count; i++) {
-            if (strcmp(arglist[i], "|") == 0) {
-                arglist[i] = NULL; // Terminate previous command
-                commands[cmd_idx] = &arglist[i + 1]; // Next command starts after '|'
-                cmd_idx++;
-            }
+// move everything from in to out, each method picked for as long as the kernel accepts the fd pair.
+// returns 0 or -1 with errno set
+static int move_data(int in, int out) {
+    enum { SPLICE, COPY_RANGE, SENDFILE, READ_WRITE } how = SPLICE;
+    char *buf = NULL;
+    ssize_t n;
+
+    for (;;) {
+        switch (how) {
+        case SPLICE: // one of them is a pipe
+            n = splice(in, NULL, out, NULL, MOVE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            break;
+        case COPY_RANGE: // file to file, can share extents on filesystems that support it
+            n = copy_file_range(in, NULL, out, NULL, MOVE_CHUNK, 0);
+            break;
+        case SENDFILE: // from a file
+            n = sendfile(out, in, NULL, MOVE_CHUNK);
+            break;
+        default:
+            if (buf == NULL && (buf = malloc(MOVE_CHUNK)) == NULL)
+                return -1;
+            n = read(in, buf, MOVE_CHUNK);
+            if (n > 0 && write_all(out, buf, n) == -1)
+                n = -1;
+            break;
+        }
+        if (n == 0)
+            break;
+        if (n > 0 || errno == EINTR)
+            continue;
+        if (how != READ_WRITE && (errno == EINVAL || errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP ||
+                                  errno == EBADF)) {
+            how++;
+            continue;
         }
-        
-        // Allocate and create pipes_counter pipes ([read, write] pairs).
-        int pipes[pipes_counter][2];
-        for (int i = 0; i < pipes_counter; i++) {
-            // initialize a new pipe and store its file descriptors in the ith row
-            // creates a new pipe and returns two file descriptors, one referring to the read end of the
-            // pipe, the other referring to the write end
-            if (pipe(pipes[i]) == -1) {
-                perror("pipe");
+        free(buf);
+        return -1;
+    }
+    free(buf);
+    return 0;
+}
+
+static int stage_fcat(struct builtin_stage *bs) {
+    int ret = 0;
+    if (bs->argv[1] == NULL) // no files: stdin
+        return move_data(bs->in_fd, bs->out_fd) == -1 && errno != EPIPE;
+    for (int i = 1; bs->argv[i]; i++) {
+        int fd = open(bs->argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1 || move_data(fd, bs->out_fd) == -1) {
+            int err = errno;
+            if (fd != -1)
+                close(fd);
+            if (err == EPIPE) // the reader is gone, like cat dying of SIGPIPE
                 return 1;
-            }
+            fprintf(stderr, "fcat: %s: %s\n", bs->argv[i], strerror(err));
+            ret = 1;
+            continue;
         }
+        close(fd);
+    }
+    return ret;
+}
 
-        for (int i = 0; i < num_cmds; i++) {
-            pid_t pid = fork();
-            if (pid == 0) {
-                signal(SIGINT, SIG_DFL); // restore Ctrl+C for children
-        
-                if (i > 0) {
-                    redirect(pipes[i - 1][READ_END], STDIN_FILENO); // if not first, read from previous pipe
-                }
-                if (i < pipes_counter) {
-                    redirect(pipes[i][WRITE_END], STDOUT_FILENO); // if not last, write to next pipe
-                }
-        
-                // Close all pipe ends in child because we already redirected them
-                for (int j = 0; j < pipes_counter; j++) {
-                    close(pipes[j][READ_END]);
-                    close(pipes[j][WRITE_END]);
-                }
-        
-                // all unnecessary pipe ends are closed, run the command
-                execvp(commands[i][0], commands[i]);
-                perror("execvp");
-                exit(1);
-            }
+// splice exactly len bytes from pipe in to out
+static int splice_all(int in, int out, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n == 0)
+                errno = EIO;
+            return -1;
         }
-        
-        for (int i = 0; i < pipes_counter; i++) {
-            close(pipes[i][READ_END]);
-            close(pipes[i][WRITE_END]);
+        len -= n;
+    }
+    return 0;
+}
+
+// stdin a pipe, stdout a pipe or a regular file: every chunk is tee'd to stdout if it's a pipe, tee'd into a
+// scratch pipe and spliced from there to stdout if it's a file and to each extra file, and finally spliced (consumed)
+// into the first file. Nothing is copied through user space.
+// A scratch pipe as large as stdin's takes a whole tee of it at once, tee can't resume halfway.
+static int ftee_splice(struct builtin_stage *bs, int out_is_pipe, int *files, int nfiles) {
+    int scratch[2] = {-1, -1}, ret = 0;
+
+    if (nfiles > 1 || !out_is_pipe) {
+        if (pipe2(scratch, O_CLOEXEC) == -1)
+            return -1;
+        fcntl(scratch[WRITE_END], F_SETPIPE_SZ, fcntl(bs->in_fd, F_GETPIPE_SZ));
+    }
+    for (;;) {
+        ssize_t n = tee(bs->in_fd, out_is_pipe ? bs->out_fd : scratch[WRITE_END], MOVE_CHUNK, 0);
+        if (n == 0)
+            break;
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            ret = -1;
+            break;
+        }
+        if (!out_is_pipe && splice_all(scratch[READ_END], bs->out_fd, n) == -1)
+            ret = -1;
+        for (int i = 1; i < nfiles && ret == 0; i++) {
+            if (tee(bs->in_fd, scratch[WRITE_END], n, 0) != n || splice_all(scratch[READ_END], files[i], n) == -1)
+                ret = -1;
+        }
+        if (ret == -1 || splice_all(bs->in_fd, files[0], n) == -1) {
+            ret = -1;
+            break;
         }
+    }
+    if (scratch[READ_END] != -1) {
+        close(scratch[READ_END]);
+        close(scratch[WRITE_END]);
+    }
+    return ret;
+}
 
-        // will block the parent process until any of its children has finished
-        // the loop is to wait for all child processes created (in no particular order)
-        for (int i = 0; i < num_cmds; i++) {
-            wait(NULL);
+static int ftee_copy(struct builtin_stage *bs, int *files, int nfiles) {
+    char *buf = malloc(MOVE_CHUNK);
+    ssize_t n;
+    int ret = 0;
+
+    if (buf == NULL)
+        return -1;
+    while ((n = read(bs->in_fd, buf, MOVE_CHUNK)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            ret = -1;
+            break;
         }
+        if (write_all(bs->out_fd, buf, n) == -1) {
+            ret = -1;
+            break;
+        }
+        for (int i = 0; i < nfiles && ret == 0; i++)
+            ret = write_all(files[i], buf, n);
+        if (ret == -1)
+            break;
+    }
+    free(buf);
+    return ret;
+}
 
+static int stage_ftee(struct builtin_stage *bs) {
+    int nfiles = 0, ret = 0;
+    struct stat in_st, out_st;
+
+    while (bs->argv[nfiles + 1])
+        nfiles++;
+    int *files = malloc((nfiles + 1) * sizeof(int));
+    if (files == NULL)
         return 1;
+    for (int i = 0; i < nfiles; i++) {
+        // created like a > redirection
+        files[i] = open(bs->argv[i + 1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (files[i] == -1) {
+            fprintf(stderr, "ftee: %s: %s\n", bs->argv[i + 1], strerror(errno));
+            for (int j = 0; j < i; j++)
+                close(files[j]);
+            free(files);
+            return 1;
+        }
     }
-    return 0;
+
+    // splice can't write to everything stdout might be (a terminal, on older kernels), that's left to ftee_copy
+    if (nfiles == 0)
+        ret = move_data(bs->in_fd, bs->out_fd);
+    else if (fstat(bs->in_fd, &in_st) == 0 && fstat(bs->out_fd, &out_st) == 0 && S_ISFIFO(in_st.st_mode) &&
+             (S_ISFIFO(out_st.st_mode) || S_ISREG(out_st.st_mode)))
+        ret = ftee_splice(bs, S_ISFIFO(out_st.st_mode), files, nfiles);
+    else
+        ret = ftee_copy(bs, files, nfiles);
+    if (ret == -1 && errno != EPIPE)
+        fprintf(stderr, "ftee: %s\n", strerror(errno));
+
+    for (int i = 0; i < nfiles; i++)
+        close(files[i]);
+    free(files);
+    return ret == -1;
 }
 
-int validate_arglist(char **arglist, int count) {
-    // Lone ampersand
-    if (count == 1 && strcmp(arglist[0], "&") == 0) {
-        fprintf(stderr, "Invalid command\n");
+static const struct {
+    const char *name;
+    int (*run)(struct builtin_stage *bs);
+} builtin_stages[] = {
+    {"fcat", stage_fcat},
+    {"ftee", stage_ftee},
+};
+
+static int (*builtin_stage_find(const char *name))(struct builtin_stage *) {
+    for (size_t i = 0; i < sizeof(builtin_stages) / sizeof(builtin_stages[0]); i++) {
+        if (strcmp(builtin_stages[i].name, name) == 0)
+            return builtin_stages[i].run;
+    }
+    return NULL;
+}
+
+static void builtin_stage_free(struct builtin_stage *bs) {
+    if (bs->argv) {
+        for (int i = 0; bs->argv[i]; i++)
+            free(bs->argv[i]);
+        free(bs->argv);
+    }
+    if (bs->in_fd != -1)
+        close(bs->in_fd);
+    if (bs->out_fd != -1)
+        close(bs->out_fd);
+    free(bs);
+}
+
+static void *builtin_stage_main(void *arg) {
+    struct builtin_stage *bs = arg;
+    int done_fd = bs->done_fd;
+    int code = bs->run(bs);
+    builtin_stage_free(bs); // closes its ends of the pipeline
+    eventfd_write(done_fd, 1);
+    return (void *)(intptr_t)code;
+}
+
+// start the builtin stage described by l (its fds are the same as a child's would be: -1 for the shell's own).
+// returns 0 with *thread and *done_fd set, or -1 after printing why
+static int builtin_stage_start(const struct launch *l, int (*run)(struct builtin_stage *), pthread_t *thread,
+                               int *done_fd) {
+    struct builtin_stage *bs = calloc(1, sizeof(*bs));
+    sigset_t block, old;
+    int argc = 0, err;
+
+    if (bs == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    bs->run = run;
+    bs->in_fd = bs->out_fd = bs->done_fd = -1;
+    while (l->argv[argc])
+        argc++;
+    if ((bs->argv = calloc(argc + 1, sizeof(char *))) == NULL)
+        goto fail;
+    for (int i = 0; i < argc; i++) {
+        if ((bs->argv[i] = strdup(l->argv[i])) == NULL)
+            goto fail;
+    }
+    // the thread's own copies: the shell closes the originals right after starting a stage
+    if ((bs->in_fd = fcntl(l->in_fd != -1 ? l->in_fd : STDIN_FILENO, F_DUPFD_CLOEXEC, 0)) == -1 ||
+        (bs->out_fd = fcntl(l->out_fd != -1 ? l->out_fd : STDOUT_FILENO, F_DUPFD_CLOEXEC, 0)) == -1 ||
+        (bs->done_fd = eventfd(0, EFD_CLOEXEC)) == -1)
+        goto fail;
+    *done_fd = bs->done_fd;
+
+    // SIGPIPE on a closed reader must hit the thread, not kill the shell: it's blocked in the thread (a pending
+    // thread-directed signal dies with it) and writes then just fail with EPIPE. Children spawned by the main
+    // thread keep its mask
+    sigemptyset(&block);
+    sigaddset(&block, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    err = pthread_create(thread, NULL, builtin_stage_main, bs);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err == 0)
+        return 0;
+    errno = err;
+fail:
+    fprintf(stderr, "%s: %s\n", l->argv[0], strerror(errno));
+    if (bs->done_fd != -1)
+        close(bs->done_fd);
+    builtin_stage_free(bs);
+    return -1;
+}
+
+// pipesize [bytes[k|m]]: pipe size for the pipes of the following pipelines (0: kernel default, usually 64 KiB).
+// Without an argument, print the current setting
+int builtin_pipesize(int count, char **arglist) {
+    char *end;
+    long size;
+    int test[2];
+
+    if (count == 1) {
+        if (pipe_size)
+            printf("%d\n", pipe_size);
+        else
+            printf("default\n");
+        return 1;
+    }
+    size = strtol(arglist[1], &end, 10);
+    if (*end == 'k' || *end == 'K')
+        size *= 1024, end++;
+    else if (*end == 'm' || *end == 'M')
+        size *= 1024 * 1024, end++;
+    if (end == arglist[1] || *end != '\0' || size < 0 || size > INT32_MAX) {
+        fprintf(stderr, "usage: pipesize [bytes[k|m]]\n");
+        return 1;
+    }
+    if (size == 0) {
+        pipe_size = 0;
+        return 1;
+    }
+    // try it now, so a size above /proc/sys/fs/pipe-max-size is reported here and not silently ignored later
+    if (pipe2(test, O_CLOEXEC) == -1) {
+        perror("pipe");
         return 1;
     }
+    int actual = fcntl(test[WRITE_END], F_SETPIPE_SZ, (int)size);
+    if (actual == -1)
+        fprintf(stderr, "pipesize: %s\n", strerror(errno));
+    else
+        pipe_size = actual; // rounded up to a power of two pages by the kernel
+    close(test[READ_END]);
+    close(test[WRITE_END]);
+    return 1;
+}
+
+// ---------- pipelines ----------
+// Every command line is one pipeline: stages separated by |, each with its own < and > redirections, optionally
+// ending with & to run in the background. A plain command is a pipeline of one stage.
+struct stage {
+    char **argv;    // NULL terminated, points into the arglist
+    char *in_file;  // < file, NULL for none
+    char *out_file; // > file, NULL for none
+    int in_fd;      // the opened files, -1 for none
+    int out_fd;
+    pid_t pid;      // -1 if it couldn't be started
+    pthread_t thread; // builtin stages: the thread running it, and done_fd its eventfd (-1 for a process)
+    int done_fd;
+};
+
+struct pipeline {
+    struct stage *stages;
+    int count;
+    int background;
+};
+
+// word i is word, written without quotes or escapes: '|' or \> are plain arguments, not operators
+static int is_unquoted(char **arglist, const char *literal, int i, const char *word) {
+    return !literal[i] && strcmp(arglist[i], word) == 0;
+}
 
-    // Check for malformed pipes
-    if (strcmp(arglist[0], "|") == 0 || strcmp(arglist[count - 1], "|") == 0) {
-        fprintf(stderr, "Invalid pipe syntax\n");
+static int is_operator(char **arglist, const char *literal, int i) {
+    return is_unquoted(arglist, literal, i, "|") || is_unquoted(arglist, literal, i, "<") || is_unquoted(arglist, literal, i, ">") ||
+           is_unquoted(arglist, literal, i, "&");
+}
+
+// split arglist into pl, in place: operators and redirection filenames are dropped from the stages' argv.
+// returns 0, or 1 after printing the syntax error. pl->stages must be freed on success
+int parse_pipeline(int count, char **arglist, const char *literal, struct pipeline *pl) {
+    int nstages = 1, out = 0;
+    struct stage *st;
+
+    // Background execution: & is only special as the last word
+    pl->background = 0;
+    if (is_unquoted(arglist, literal, count - 1, "&")) {
+        pl->background = 1;
+        arglist[--count] = NULL;
+    }
+    if (count == 0) {
+        fprintf(stderr, "Invalid command\n");
         return 1;
     }
-    for (int i = 1; i < count; i++) {
-        if (strcmp(arglist[i], "|") == 0 && strcmp(arglist[i - 1], "|") == 0) {
+
+    for (int i = 0; i < count; i++) {
+        if (!is_unquoted(arglist, literal, i, "|"))
+            continue;
+        if (i == 0 || i == count - 1 || is_unquoted(arglist, literal, i - 1, "|")) {
             fprintf(stderr, "Invalid pipe syntax\n");
             return 1;
         }
+        nstages++;
     }
-
-    // Check for redirection with no filename
-    int input_idx = find_symbol(arglist, count, "<");
-    int output_idx = find_symbol(arglist, count, ">");
-    if ((input_idx != -1 && input_idx + 1 >= count) ||
-        (output_idx != -1 && output_idx + 1 >= count)) {
-        fprintf(stderr, "Missing filename\n");
+    pl->stages = malloc(nstages * sizeof(*pl->stages));
+    if (pl->stages == NULL) {
+        perror("malloc");
         return 1;
     }
+    pl->count = nstages;
+
+    // words are compacted towards the front of arglist, every stage's argv ends with a NULL written over an
+    // operator or filename it no longer needs (out never passes i)
+    st = pl->stages;
+    *st = (struct stage){.argv = arglist, .in_fd = -1, .out_fd = -1, .done_fd = -1};
+    for (int i = 0; i < count; i++) {
+        char *word = arglist[i];
+        if (is_unquoted(arglist, literal, i, "|")) {
+            arglist[out++] = NULL;
+            *++st = (struct stage){.argv = &arglist[out], .in_fd = -1, .out_fd = -1, .done_fd = -1};
+        } else if (is_unquoted(arglist, literal, i, "<") || is_unquoted(arglist, literal, i, ">")) {
+            // I expect a filename after the < or >, not the end of the line or another operator
+            if (i + 1 >= count || is_operator(arglist, literal, i + 1)) {
+                fprintf(stderr, "Missing filename\n");
+                free(pl->stages);
+                return 1;
+            }
+            if (word[0] == '<')
+                st->in_file = arglist[++i];
+            else
+                st->out_file = arglist[++i];
+        } else {
+            arglist[out++] = word;
+        }
+    }
+    arglist[out] = NULL;
+
+    for (int i = 0; i < nstages; i++) {
+        if (pl->stages[i].argv[0] == NULL) { // only redirections
+            fprintf(stderr, "Invalid command\n");
+            free(pl->stages);
+            return 1;
+        }
+    }
     return 0;
 }
 
+static void close_redirections(struct pipeline *pl) {
+    for (int i = 0; i < pl->count; i++) {
+        if (pl->stages[i].in_fd != -1)
+            close(pl->stages[i].in_fd);
+        if (pl->stages[i].out_fd != -1)
+            close(pl->stages[i].out_fd);
+        pl->stages[i].in_fd = pl->stages[i].out_fd = -1;
+    }
+}
 
-int process_arglist(int count, char **arglist) {
-    int retVal, background = 0;
+// Open every redirection before starting anything, so a bad filename is reported without running any stage.
+// O_CLOEXEC: the child only gets them through launch's dup2
+static int open_redirections(struct pipeline *pl) {
+    for (int i = 0; i < pl->count; i++) {
+        struct stage *st = &pl->stages[i];
+        if (st->in_file && (st->in_fd = open(st->in_file, O_RDONLY | O_CLOEXEC)) == -1) {
+            perror("open input");
+            close_redirections(pl);
+            return -1;
+        }
+        // open the output file for writing, create or truncate it
+        if (st->out_file &&
+            (st->out_fd = open(st->out_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR)) == -1) {
+            perror("open output");
+            close_redirections(pl);
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    retVal = validate_arglist(arglist, count);
-    if (retVal == 1)
-        return retVal;
+// start every stage as one job. returns NULL if nothing could be started
+struct job *run_pipeline(struct pipeline *pl, const char *cmdline) {
+    int prev_read = -1; // read end of the pipe from the previous stage
+    struct job *job;
 
-    // Background execution
-    // I remove & from the argument list (and not giving it to execvp())
-    // Later we would not waitpid() to the child if background
-    if (strcmp(arglist[count - 1], "&") == 0) {
-        background = 1;
-        arglist[count - 1] = NULL;
-        count--;
+    // without a prompt flushing it after every line, builtin output could still be buffered here and show up after
+    // the children's
+    fflush(stdout);
+    if (open_redirections(pl) != 0)
+        return NULL;
+    if ((job = job_new(cmdline, pl->count, pl->background)) == NULL) {
+        perror("malloc");
+        close_redirections(pl);
+        return NULL;
     }
 
-    retVal = handle_input_redirection(arglist, count);
-    if (retVal == 1)
-        return retVal;
+    for (int i = 0; i < pl->count; i++) {
+        struct stage *st = &pl->stages[i];
+        int pipefd[2] = {-1, -1};
 
-    retVal = handle_output_redirection(arglist, count);
-    if (retVal == 1)
-        return retVal;
+        // a pipe to the next stage, unless both of its ends would be replaced by files.
+        // O_CLOEXEC: each child only gets the ends it dup2s
+        if (i + 1 < pl->count && !(st->out_fd != -1 && pl->stages[i + 1].in_fd != -1) &&
+            pipe2(pipefd, O_CLOEXEC) == -1) {
+            perror("pipe");
+            for (; i < pl->count; i++)
+                pl->stages[i].pid = -1;
+            break;
+        }
+        if (pipefd[WRITE_END] != -1 && pipe_size)
+            fcntl(pipefd[WRITE_END], F_SETPIPE_SZ, pipe_size); // checked by pipesize already
+
+        // a redirection wins over the pipe, like in sh
+        struct launch l = {
+            .argv = st->argv,
+            .in_fd = st->in_fd != -1 ? st->in_fd : prev_read,
+            .out_fd = st->out_fd != -1 ? st->out_fd : pipefd[WRITE_END],
+            .sigint_default = !pl->background, // background stages keep ignoring Ctrl+C
+        };
+        int (*run)(struct builtin_stage *) = builtin_stage_find(st->argv[0]);
+        if (run)
+            st->pid = builtin_stage_start(&l, run, &st->thread, &st->done_fd) == 0 ? 0 : -1;
+        else
+            st->pid = launch(&l);
 
-    retVal = handle_pipes(arglist, count);
-    if (retVal == 1)
-        return retVal;
+        // drop the shell's copies as soon as the children have theirs, so each reader sees EOF when its writer
+        // exits and at most one pipe is open in the shell at a time
+        if (prev_read != -1)
+            close(prev_read);
+        if (pipefd[WRITE_END] != -1)
+            close(pipefd[WRITE_END]);
+        prev_read = pipefd[READ_END];
+    }
+    if (prev_read != -1)
+        close(prev_read);
+    close_redirections(pl);
 
-    pid_t pid = fork();
-    if (pid == 0) {
-        // Restore the SIGINT for child and set it based on foreground/background
-        signal(SIGINT, background ? SIG_IGN : SIG_DFL);
-        execvp(arglist[0], arglist);
-        perror("execvp");
-        exit(1);
-    } else if (pid > 0) {
-        if (!background) {
-            waitpid(pid, NULL, 0);
+    // stages that didn't start leave no proc behind, so the last stage isn't necessarily the last proc. if it's
+    // missing, the job reports 127 like sh does for a command it couldn't run
+    job->last = -1;
+    job->status = W_EXITCODE(127, 0);
+    for (int i = 0; i < pl->count; i++) {
+        if (i == pl->count - 1 && (pl->stages[i].done_fd != -1 || pl->stages[i].pid > 0))
+            job->last = job->nprocs;
+        if (pl->stages[i].done_fd != -1)
+            job_add_thread(job, pl->stages[i].thread, pl->stages[i].done_fd, pl->stages[i].argv[0]);
+        else if (pl->stages[i].pid > 0)
+            job_add_proc(job, pl->stages[i].pid, pl->stages[i].argv[0]);
+    }
+    if (job->nprocs == 0) {
+        job_remove(job);
+        return NULL;
+    }
+    return job;
+}
+
+// the command line as typed (words joined by spaces), for job listings. the buffer is reused across calls, so it's
+// only good until the next one
+static const char *command_line(int count, char **arglist) {
+    static char *buf;
+    static size_t size;
+    size_t len = 0;
+
+    for (int i = 0; i < count; i++)
+        len += strlen(arglist[i]) + 1;
+    if (len > size) {
+        char *grown = realloc(buf, len);
+        if (grown == NULL)
+            return "";
+        buf = grown;
+        size = len;
+    }
+    len = 0;
+    for (int i = 0; i < count; i++) {
+        size_t word = strlen(arglist[i]);
+        memcpy(buf + len, arglist[i], word);
+        len += word;
+        buf[len++] = ' ';
+    }
+    buf[len - 1] = '\0';
+    return buf;
+}
+
+// ---------- parallel ----------
+// parallel [-j N] [-a file] command [args...]
+// Runs command once per input line, with every {} in its arguments replaced by the line (or the line appended as
+// the last argument if there is no {}), keeping up to N of them running at a time (default: the CPUs we may run
+// on). Lines come from -a file, else from the builtin's < redirection, else from stdin. Each job's exit status and
+// run time is reported on stderr as it finishes, followed by a summary.
+// When the lines come from stdin, the jobs get /dev/null as theirs (like xargs): a job that reads its input would
+// otherwise eat lines meant for later jobs, depending on timing.
+
+static int available_cpus(void) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        return CPU_COUNT(&set);
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// template with its {} replaced by line. NULL if out of memory, else free with free_argv
+static char **fill_template(char **template, int count, const char *line) {
+    int has_braces = 0;
+    char **argv = calloc(count + 2, sizeof(char *));
+
+    if (argv == NULL)
+        return NULL;
+    for (int i = 0; i < count; i++) {
+        const char *word = template[i], *brace;
+        size_t len = 0;
+        for (brace = strstr(word, "{}"); brace; brace = strstr(brace + 2, "{}"))
+            has_braces = 1, len++;
+        len = strlen(word) + len * strlen(line) + 1;
+        char *out = argv[i] = malloc(len);
+        if (out == NULL)
+            goto oom;
+        while ((brace = strstr(word, "{}")) != NULL) {
+            memcpy(out, word, brace - word);
+            out += brace - word;
+            out = stpcpy(out, line);
+            word = brace + 2;
         }
-    } else {
-        perror("fork");
+        strcpy(out, word);
+    }
+    if (!has_braces && (argv[count] = strdup(line)) == NULL)
+        goto oom;
+    return argv;
+oom:
+    for (int i = 0; argv[i]; i++)
+        free(argv[i]);
+    free(argv);
+    return NULL;
+}
+
+static void free_argv(char **argv) {
+    for (int i = 0; argv[i]; i++)
+        free(argv[i]);
+    free(argv);
+}
+
+static void parallel_report(const struct job *job, int seq) {
+    int status = job->status;
+    fprintf(stderr, "parallel: [%d] ", seq);
+    if (WIFSIGNALED(status))
+        fprintf(stderr, "%s", strsignal(WTERMSIG(status)));
+    else
+        fprintf(stderr, "exit %d", WEXITSTATUS(status));
+    fprintf(stderr, " %.3fs: %s\n", elapsed(&job->started, &job->finished), job->cmdline);
+}
+
+int builtin_parallel(int count, char **arglist, const char *in_file) {
+    const char *arg_file = in_file;
+    int max_jobs = available_cpus(), first = 1;
+    struct timespec t0, t1;
+
+    for (; first < count && arglist[first][0] == '-'; first++) {
+        if (strcmp(arglist[first], "-j") == 0 && first + 1 < count) {
+            max_jobs = atoi(arglist[++first]);
+        } else if (strcmp(arglist[first], "-a") == 0 && first + 1 < count) {
+            arg_file = arglist[++first];
+        } else {
+            break;
+        }
+    }
+    if (first >= count || max_jobs < 1) {
+        fprintf(stderr, "usage: parallel [-j N] [-a file] command [args...]\n");
+        return 1;
+    }
+
+    FILE *input = arg_file ? fopen(arg_file, "re") : stdin;
+    if (input == NULL) {
+        perror(arg_file);
         return 1;
     }
+    int null_fd = input == stdin ? open("/dev/null", O_RDONLY | O_CLOEXEC) : -1;
+    if (input == stdin && null_fd == -1) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    // slots[i] is the job running in worker slot i, seqs[i] its input line number
+    struct job **slots = calloc(max_jobs, sizeof(*slots));
+    int *seqs = calloc(max_jobs, sizeof(*seqs));
+    char *line = NULL;
+    size_t line_size = 0;
+    int active = 0, seq = 0, failed = 0, interrupted = 0, eof = 0;
+
+    if (slots == NULL || seqs == NULL) {
+        perror("calloc");
+        eof = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fflush(stdout);
+    while (active > 0 || !eof) {
+        // keep every slot busy while there is input
+        while (!eof && !interrupted && active < max_jobs) {
+            ssize_t len = getline(&line, &line_size, input);
+            if (len == -1) {
+                eof = 1;
+                break;
+            }
+            if (len > 0 && line[len - 1] == '\n')
+                line[--len] = '\0';
+            if (len == 0)
+                continue;
+            seq++;
 
+            char **argv = fill_template(&arglist[first], count - first, line);
+            struct job *job;
+            pid_t pid;
+            if (argv == NULL) {
+                perror("malloc");
+                eof = 1;
+                break;
+            }
+            int argc = 0;
+            while (argv[argc])
+                argc++;
+            job = job_new(command_line(argc, argv), 1, 0);
+            struct launch l = {.argv = argv, .in_fd = null_fd, .out_fd = -1, .sigint_default = 1};
+            pid = job ? launch(&l) : -1;
+            if (pid != -1)
+                job_add_proc(job, pid, argv[0]);
+            free_argv(argv);
+            if (pid == -1) {
+                failed++;
+                if (job)
+                    job_remove(job);
+                continue;
+            }
+            int slot = 0;
+            while (slots[slot])
+                slot++;
+            slots[slot] = job;
+            seqs[slot] = seq;
+            active++;
+        }
+        if (interrupted)
+            eof = 1;
+        if (active == 0)
+            break;
+
+        struct job_proc *p = NULL;
+        for (int i = 0; i < max_jobs && !p; i++)
+            p = slots[i] ? job_unwatched(slots[i]) : NULL;
+        if (p)
+            proc_reap(p, 0);
+        else
+            jobs_poll(-1);
+        for (int i = 0; i < max_jobs; i++) {
+            struct job *job = slots[i];
+            if (job == NULL || job->running > 0)
+                continue;
+            parallel_report(job, seqs[i]);
+            if (!WIFEXITED(job->status) || WEXITSTATUS(job->status) != 0)
+                failed++;
+            // Ctrl+C reaches the jobs (the shell ignores it): don't start new ones after that
+            if (WIFSIGNALED(job->status) && WTERMSIG(job->status) == SIGINT)
+                interrupted = 1;
+            job_remove(job);
+            slots[i] = NULL;
+            active--;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fprintf(stderr, "parallel: %d jobs, %d failed, %.3fs%s\n", seq, failed, elapsed(&t0, &t1),
+            interrupted ? ", interrupted" : "");
+
+    free(line);
+    free(slots);
+    free(seqs);
+    if (input != stdin)
+        fclose(input);
+    else
+        clearerr(stdin); // an interactive user ended the list with Ctrl+D, the shell goes on
+    if (null_fd != -1)
+        close(null_fd);
+    return 1;
+}
+
+// builtins run inside the shell, for a single-stage pipeline. returns -1 if argv isn't one
+// > file applies to everything the builtin (and whatever it starts) writes to stdout. None reads stdin, except
+// parallel which takes its input lines from the < file; for the others the file only has to exist.
+// They can't run in the background.
+static int run_builtin(struct stage *st, int background) {
+    int argc = 0, saved_stdout = -1, ret;
+    while (st->argv[argc])
+        argc++;
+
+    static const char *const names[] = {"hash", "jobs", "wait", "fg", "pipesize", "parallel", "acct", NULL};
+    int i = 0;
+    while (names[i] && strcmp(st->argv[0], names[i]) != 0)
+        i++;
+    if (!names[i])
+        return -1;
+    if (background) {
+        fprintf(stderr, "%s: builtins can't run in the background\n", st->argv[0]);
+        return 1;
+    }
+    if (st->in_file || st->out_file) {
+        struct pipeline pl = {.stages = st, .count = 1};
+        if (open_redirections(&pl) != 0)
+            return 1;
+        if (st->out_fd != -1) {
+            fflush(stdout);
+            if ((saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10)) == -1 ||
+                dup2(st->out_fd, STDOUT_FILENO) == -1) {
+                perror("dup2");
+                if (saved_stdout != -1)
+                    close(saved_stdout);
+                close_redirections(&pl);
+                return 1;
+            }
+        }
+        close_redirections(&pl);
+    }
+
+    if (strcmp(st->argv[0], "hash") == 0)
+        ret = builtin_hash(argc, st->argv);
+    else if (strcmp(st->argv[0], "jobs") == 0)
+        ret = builtin_jobs(argc, st->argv);
+    else if (strcmp(st->argv[0], "wait") == 0)
+        ret = builtin_wait(argc, st->argv);
+    else if (strcmp(st->argv[0], "fg") == 0)
+        ret = builtin_fg(argc, st->argv);
+    else if (strcmp(st->argv[0], "pipesize") == 0)
+        ret = builtin_pipesize(argc, st->argv);
+    else if (strcmp(st->argv[0], "parallel") == 0)
+        ret = builtin_parallel(argc, st->argv, st->in_file);
+    else
+        ret = builtin_acct(argc, st->argv);
+
+    if (saved_stdout != -1) {
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+    return ret;
+}
+
+// run_builtin, measured when timed or logged: builtins run in the shell itself, so what they cost is the shell's
+// usage while they ran plus that of any children they reaped (parallel's)
+static int run_builtin_timed(struct stage *st, int background, const char *cmdline, int timed) {
+    struct rusage self[2], children[2];
+    struct timespec start, end;
+    int ret;
+
+    if (!timed && !acct_log)
+        return run_builtin(st, background);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    getrusage(RUSAGE_SELF, &self[0]);
+    getrusage(RUSAGE_CHILDREN, &children[0]);
+    if ((ret = run_builtin(st, background)) == -1)
+        return -1;
+    getrusage(RUSAGE_SELF, &self[1]);
+    getrusage(RUSAGE_CHILDREN, &children[1]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    rusage_sub(&self[1], &self[0]);
+    rusage_sub(&children[1], &children[0]);
+    rusage_add(&self[1], &children[1]);
+    if (timed)
+        time_report(elapsed(&start, &end), &self[1]);
+    if (acct_log)
+        acct_write_builtin(cmdline, elapsed(&start, &end), &self[1]);
+    return ret;
+}
+
+int process_arglist(int count, char **arglist, const char *literal) {
+    struct pipeline pl;
+    struct job *job;
+    char *cmdline;
+    int timed = 0;
+
+    // time cmd...: run the rest of the line and report what it cost, see accounting
+    if (is_unquoted(arglist, literal, 0, "time")) {
+        if (count == 1) {
+            fprintf(stderr, "usage: time command [args...]\n");
+            return 1;
+        }
+        timed = 1;
+        arglist++;
+        literal++;
+        count--;
+    }
+    // a copy: builtins like parallel call command_line again, and the accounting record is written after them
+    if ((cmdline = strdup(command_line(count, arglist))) == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    jobs_notify();
+    if (parse_pipeline(count, arglist, literal, &pl) != 0) {
+        free(cmdline);
+        return 1;
+    }
+    if (pl.count != 1 || run_builtin_timed(&pl.stages[0], pl.background, cmdline, timed) == -1) {
+        job = run_pipeline(&pl, cmdline);
+        if (job)
+            job->timed = timed;
+        if (job && pl.background && interactive) {
+            pid_t last = 0; // of the last process, builtin stages have none
+            for (int i = 0; i < job->nprocs; i++)
+                last = job->procs[i].is_thread ? last : job->procs[i].pid;
+            printf("[%d] %d\n", job->id, (int)last);
+        } else if (job && !pl.background) {
+            job_wait(job);
+            job_remove(job);
+        }
+    }
+    free(pl.stages);
+    free(cmdline);
     return 1;
 }
@@ -3,67 +3,217 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // arglist - a list of char* arguments (words) provided by the user
 // it contains count+1 items, where the last item (arglist[count]) and *only* the last is NULL
+// literal - count flags, literal[i] is nonzero if word i was quoted or escaped anywhere, so it can't be an operator
 // RETURNS - 1 if should continue, 0 otherwise
-int process_arglist(int count, char** arglist);
+int process_arglist(int count, char** arglist, const char* literal);
 
 // prepare and finalize calls for initialization and destruction of anything required
 int prepare(void);
 int finalize(void);
 
-int main(void)
+// Usage: myshell [script]
+// Without a script, lines are read from stdin after a prompt. With one, the file is run line by line without
+// prompting, and an unquoted # at the start of a word starts a comment that runs to the end of the line (so a #!
+// line is skipped). Inside a word, # is an ordinary character.
+//
+// Lines are split into words in place: the words are pieces of the line buffer itself, and both the line buffer and
+// the arglist array are reused for every line, so a long script costs no allocation per line.
+// Quoting works as in sh, minus expansions: '...' is literal, inside "..." a backslash only escapes " and \,
+// and outside quotes a backslash escapes any character.
+
+#define SCRIPT_BUF_SIZE (64 * 1024)
+
+static char** arglist;
+static char* literal; // per word, see process_arglist
+static size_t arglist_size; // allocated entries, of both
+
+// split line (NUL terminated) into words, in place. returns the word count with arglist[count] == NULL,
+// or -1 after printing an error
+static int tokenize(char* line, int script)
 {
-	if (prepare() != 0)
-		exit(1);
-	
-	while (1)
-	{
-		char** arglist = NULL;
-		char* line = NULL;
-		size_t size;
-		int count = 0;
+	char* src = line;
+	char* dst = line; // words are compacted over the quotes and escapes they were written with
+	int count = 0;
 
-		printf("myshell$ ");
-		fflush(stdout); // Make sure prompt shows up before input
-		
-		if (getline(&line, &size, stdin) == -1) {
-			free(line);
+	for (;;) {
+		while (*src == ' ' || *src == '\t' || *src == '\n' || *src == '\r')
+			src++;
+		if (*src == '\0' || (script && *src == '#'))
 			break;
+
+		if ((size_t)count + 2 > arglist_size) {
+			size_t size = arglist_size ? arglist_size * 2 : 16;
+			char** grown = (char**) realloc(arglist, sizeof(char*) * size);
+			char* grown_literal = grown ? (char*) realloc(literal, size) : NULL;
+			if (grown == NULL || grown_literal == NULL) {
+				printf("realloc failed: %s\n", strerror(errno));
+				exit(1);
+			}
+			arglist = grown;
+			literal = grown_literal;
+			arglist_size = size;
+		}
+		literal[count] = 0;
+		arglist[count++] = dst;
+
+		char quote = 0;
+		for (; *src != '\0'; src++) {
+			char c = *src;
+			if (quote == '\'') {
+				if (c == '\'')
+					quote = 0;
+				else
+					*dst++ = c;
+			} else if (quote == '"') {
+				if (c == '"')
+					quote = 0;
+				else if (c == '\\' && (src[1] == '"' || src[1] == '\\'))
+					*dst++ = *++src;
+				else
+					*dst++ = c;
+			} else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+				break;
+			} else if (c == '\'' || c == '"') {
+				quote = c;
+				literal[count - 1] = 1;
+			} else if (c == '\\' && src[1] != '\0') {
+				*dst++ = *++src;
+				literal[count - 1] = 1;
+			} else {
+				*dst++ = c;
+			}
 		}
-		
-    
-		arglist = (char**) malloc(sizeof(char*));
-		if (arglist == NULL) {
+		if (quote) {
+			fprintf(stderr, "Unterminated quote\n");
+			return -1;
+		}
+		// dst can't have passed src, so terminating the word never overwrites unread input
+		if (*src != '\0')
+			src++;
+		*dst++ = '\0';
+	}
+	if (arglist == NULL) { // empty first line
+		arglist_size = 16;
+		if ((arglist = (char**) malloc(sizeof(char*) * arglist_size)) == NULL ||
+		    (literal = (char*) malloc(arglist_size)) == NULL) {
 			printf("malloc failed: %s\n", strerror(errno));
 			exit(1);
 		}
-		arglist[0] = strtok(line, " \t\n");
-    
-		while (arglist[count] != NULL) {
-			++count;
-			arglist = (char**) realloc(arglist, sizeof(char*) * (count + 1));
-			if (arglist == NULL) {
+	}
+	arglist[count] = NULL;
+	return count;
+}
+
+// tokenize and run one line. returns 0 if the shell should stop
+static int run_line(char* line, int script)
+{
+	int count = tokenize(line, script);
+	if (count <= 0)
+		return 1;
+	return process_arglist(count, arglist, literal);
+}
+
+static void run_interactive(void)
+{
+	char* line = NULL;
+	size_t size = 0;
+
+	while (1) {
+		printf("myshell$ ");
+		fflush(stdout); // Make sure prompt shows up before input
+
+		if (getline(&line, &size, stdin) == -1)
+			break;
+		if (!run_line(line, 0))
+			break;
+	}
+	free(line);
+}
+
+// read the script in large chunks and run it a line at a time, the newline itself becomes the line's terminator
+static int run_script(const char* path)
+{
+	size_t size = SCRIPT_BUF_SIZE, start = 0, end = 0;
+	char* buf = (char*) malloc(size + 1);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	int running = 1, eof = 0;
+
+	if (fd == -1 || buf == NULL) {
+		perror(path);
+		free(buf);
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+
+	while (running) {
+		char* nl = (char*) memchr(buf + start, '\n', end - start);
+		if (nl != NULL) {
+			*nl = '\0';
+			running = run_line(buf + start, 1);
+			start = nl + 1 - buf;
+			continue;
+		}
+		if (eof) {
+			if (start < end) { // last line without a newline
+				buf[end] = '\0';
+				run_line(buf + start, 1);
+			}
+			break;
+		}
+
+		// keep the partial line, at the front of the buffer, and grow the buffer if it is a single line
+		memmove(buf, buf + start, end - start);
+		end -= start;
+		start = 0;
+		if (end == size) {
+			char* grown = (char*) realloc(buf, size * 2 + 1);
+			if (grown == NULL) {
 				printf("realloc failed: %s\n", strerror(errno));
 				exit(1);
 			}
-      
-			arglist[count] = strtok(NULL, " \t\n");
+			buf = grown;
+			size *= 2;
 		}
-    
-		if (count != 0) {
-			if (!process_arglist(count, arglist)) {
-				free(line);
-				free(arglist);
-				break;
-			}
+		ssize_t n = read(fd, buf + end, size - end);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			perror(path);
+			break;
 		}
-    
-		free(line);
-		free(arglist);
+		if (n == 0)
+			eof = 1;
+		end += n;
+	}
+	close(fd);
+	free(buf);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [script]\n", argv[0]);
+		exit(1);
 	}
-	
+	if (prepare() != 0)
+		exit(1);
+
+	if (argc == 2) {
+		if (run_script(argv[1]) != 0)
+			exit(1);
+	} else {
+		run_interactive();
+	}
+	free(arglist);
+	free(literal);
+
 	if (finalize() != 0)
 		exit(1);
 
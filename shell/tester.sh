@@ -279,6 +279,15 @@ chmod 000 "$TEMP_DIR/no_write_dir"
 run_test_no_file "Output Redir: Permission denied" "echo Denied > $TEMP_DIR/no_write_dir/denied.txt" "no_write_dir/denied.txt" "Permission denied"
 chmod 755 "$TEMP_DIR/no_write_dir" # Cleanup permissions before removal
 
+# --- 5b. Pipelines with Redirection and Background ---
+echo -e "\n--- Testing Combined Pipelines ---"
+run_test_file_content "Combined: < in | cmd > out" "cat < $TEMP_DIR/input.txt | tr a-z A-Z > $TEMP_DIR/combo.txt" "combo.txt" "TEST FILE FOR INPUT REDIRECTION."
+run_test_background_timing "Combined: background pipeline" "sleep 1 | cat &" 1
+long_pipe_cmd="echo LongPipeTest"
+for i in {1..20}; do long_pipe_cmd="$long_pipe_cmd | cat"; done
+run_test_output "Combined: 21 stages" "$long_pipe_cmd" "LongPipeTest" "stdout"
+run_test_output "Combined: redirection without command" "< $TEMP_DIR/input.txt" "Invalid command" "stderr"
+
 # --- 6. Error Handling & Invalid Syntax ---
 echo -e "\n--- Testing Error Handling & Invalid Syntax ---"
 run_test_output "Error: Command not found" "a_very_unlikely_command_name" "No such file or directory" "stderr"
@@ -287,6 +296,10 @@ echo "#!/bin/bash\necho Executable" > "$TEMP_DIR/noexec.sh"
 chmod 000 "$TEMP_DIR/noexec.sh"
 run_test_output "Error: Execution permission denied" "./$TEMP_DIR/execvp" "Permission denied" "stderr"
 chmod 755 "$TEMP_DIR/noexec.sh" # Cleanup permissions
+# An executable without a #! line runs as a shell script, like execvp does
+echo 'echo "script ran with $1"' > "$TEMP_DIR/noshebang"
+chmod 755 "$TEMP_DIR/noshebang"
+run_test_output "Exec: script without #! runs via /bin/sh" "./$TEMP_DIR/noshebang arg1" "script ran with arg1" "stdout"
 # Test parent syntax errors (checking stderr as your code does)
 run_test_output "Syntax Error: '&' alone" "&" "Invalid command" "stderr"
 run_test_output "Syntax Error: 'cmd |'" "echo foo |" "Invalid pipe syntax" "stderr"
@@ -295,9 +308,105 @@ run_test_output "Syntax Error: 'cmd | | cmd'" "echo foo | | cat" "Invalid pipe s
 run_test_output "Syntax Error: Missing redir filename '<'" "cat <" "Missing filename" "stderr"
 run_test_output "Syntax Error: Missing redir filename '>'" "echo foo >" "Missing filename" "stderr"
 
+# --- 6b. Command hash ---
+echo -e "\n--- Testing Command Hash ---"
+run_test_output "Hash: lists a command after running it" $'ls /dev/null\nhash' "/ls$" "stdout"
+run_test_output "Hash: -r empties the table" $'ls /dev/null\nhash -r\nhash' "hash table empty" "stdout"
+run_test_output "Hash: unknown name" "hash a_very_unlikely_command_name" "not found" "stderr"
+for launcher in spawn fork; do
+    start_test "Hash: a removed command is looked up again ($launcher)"
+    mkdir -p "$TEMP_DIR/path1" "$TEMP_DIR/path2"
+    printf '#!/bin/sh\necho first\n' > "$TEMP_DIR/path1/hashed_cmd"
+    printf '#!/bin/sh\necho second\n' > "$TEMP_DIR/path2/hashed_cmd"
+    chmod 755 "$TEMP_DIR/path1/hashed_cmd" "$TEMP_DIR/path2/hashed_cmd"
+    hash_cmd=$'hashed_cmd\nrm '"$TEMP_DIR"$'/path1/hashed_cmd\nhashed_cmd'
+    if [ "$launcher" == "fork" ]; then export MYSHELL_FORK=1; fi
+    hash_out=$(echo "$hash_cmd" | PATH="$PWD/$TEMP_DIR/path1:$PWD/$TEMP_DIR/path2:$PATH" $SHELL_EXEC 2>&1)
+    unset MYSHELL_FORK
+    if [[ "$hash_out" == *first*second* && "$hash_out" != *"No such file"* ]]; then
+        print_pass
+    else
+        print_fail "Stale hash entry used" "$hash_cmd" "first, then second" "$hash_out" ""
+    fi
+done
+
+# --- 6c. Jobs ---
+echo -e "\n--- Testing Jobs ---"
+run_test_output "Jobs: jobs lists a running job" $'sleep 0.3 &\njobs' "Running" "stdout"
+run_test_output "Jobs: exit status recorded" $'false &\nsleep 0.1\njobs' "Exit 1" "stdout"
+run_test_output "Jobs: status of a pipeline whose last stage can't start" $'true | no_such_command_xyz &\nsleep 0.1\njobs' "Exit 127" "stdout"
+run_test_output "Jobs: wait for all" $'sleep 0.2 &\nsleep 0.1 &\nwait\njobs\necho Waited' "Waited" "stdout"
+run_test_output "Jobs: wait unknown job" "wait %7" "no such job" "stderr"
+start_test "Jobs: finished background jobs reaped while idle at the prompt"
+mkfifo "$TEMP_DIR/idle_in"
+$SHELL_EXEC < "$TEMP_DIR/idle_in" > /dev/null 2>&1 &
+idle_pid=$!
+exec 3> "$TEMP_DIR/idle_in"
+echo 'sleep 0.2 &' >&3
+echo 'sleep 0.2 | cat &' >&3
+sleep 1 # no more input meanwhile: the shell is idle
+zombies=$(ps -o stat=,cmd= --ppid $idle_pid | grep '^Z')
+exec 3>&-
+wait $idle_pid
+if [ -z "$zombies" ]; then
+    print_pass
+else
+    print_fail "Zombies left while the shell was idle" "sleep 0.2 &, then no input for 1s" "no <defunct> children" "$zombies" ""
+fi
+
+# --- 6d. Quoting and Script Mode ---
+echo -e "\n--- Testing Quoting & Script Mode ---"
+run_test_output "Quoting: double and single quotes" "echo \"a  b\" 'c|d'" "a  b c|d" "stdout"
+run_test_output "Quoting: unterminated quote" "echo \"abc" "Unterminated quote" "stderr"
+run_test_output "Quoting: quoted operators are arguments" "echo '|' \"<\" \\> '&'" "| < > &" "stdout"
+run_test_output "Quoting: quoted pipe inside a pipeline" "echo 'a|b' \"|\" | cat" "a|b |" "stdout"
+start_test "Script: runs a file without prompts"
+printf '#!/bin/myshell\n# comment\necho ScriptLine1 # trailing comment\necho "Script Line2" | cat\necho No#Newline' > "$TEMP_DIR/script.sh"
+script_out=$($SHELL_EXEC "$TEMP_DIR/script.sh" 2>&1)
+if [ "$script_out" == $'ScriptLine1\nScript Line2\nNo#Newline' ]; then
+    print_pass
+else
+    print_fail "Unexpected script output" "$SHELL_EXEC script.sh" "three lines, no prompt" "$script_out" ""
+fi
+
+# --- 6e. Parallel ---
+echo -e "\n--- Testing Parallel ---"
+printf '1\n2\n3\n' > "$TEMP_DIR/par_args.txt"
+run_test_output "Parallel: template substitution" "parallel -j 2 -a $TEMP_DIR/par_args.txt echo Par{}" "Par3" "stdout"
+run_test_output "Parallel: summary" "parallel -j 2 echo x < $TEMP_DIR/par_args.txt" "3 jobs, 0 failed" "stderr"
+run_test_output "Parallel: failing jobs counted" "parallel -a $TEMP_DIR/par_args.txt false" "3 jobs, 3 failed" "stderr"
+start_test "Parallel: jobs don't read the argument lines"
+# the later lines arrive while the first job runs, it would get them if it shared the shell's stdin
+par_err=$({ echo "parallel -j 1 sh -c 'cat; echo got \$0'"; echo line1; sleep 0.3; printf 'line2\nline3\n'; } | $SHELL_EXEC 2>&1 >/dev/null)
+if [[ "$par_err" == *"3 jobs, 0 failed"* ]]; then
+    print_pass
+else
+    print_fail "Argument lines read by a job" "parallel -j 1 sh -c 'cat; echo got \$0' (lines on stdin)" "3 jobs, 0 failed" "" "$par_err"
+fi
+
+# --- 6f. Builtin Stages & Pipe Size ---
+echo -e "\n--- Testing Builtin Stages ---"
+run_test_output "Stages: fcat into a pipe" "fcat $TEMP_DIR/input.txt | cat" "Test file for input redirection." "stdout"
+run_test_file_content "Stages: ftee copies to a file" "fcat $TEMP_DIR/input.txt | ftee $TEMP_DIR/tee.txt | cat > $TEMP_DIR/tee_out.txt" "tee.txt" "Test file for input redirection."
+run_test_file_content "Stages: ftee with stdout redirected to a file" "fcat $TEMP_DIR/input.txt | ftee $TEMP_DIR/tee2.txt $TEMP_DIR/tee3.txt > $TEMP_DIR/tee2_out.txt" "tee2_out.txt" "Test file for input redirection."
+run_test_output "Stages: fcat missing file" "fcat $TEMP_DIR/no_such_file.txt" "No such file or directory" "stderr"
+run_test_output "Pipesize: set and show" $'pipesize 256k\npipesize' "262144" "stdout"
+run_test_file_content "Builtins: output redirected to a file" $'pipesize 256k\npipesize > '"$TEMP_DIR"'/pipesize.txt' "pipesize.txt" "262144"
+run_test_output "Builtins: missing input file" "hash < $TEMP_DIR/no_such_file.txt" "No such file or directory" "stderr"
+run_test_output "Builtins: no background" "jobs &" "can't run in the background" "stderr"
+
+# --- 6g. Time & Accounting ---
+echo -e "\n--- Testing Time & Accounting ---"
+run_test_output "Time: external command" "time sleep 0.1" "real" "stderr"
+run_test_output "Time: pipeline output kept" "time echo timed | cat" "timed" "stdout"
+run_test_output "Time: no command" "time" "usage" "stderr"
+run_test_output "Acct: logs each command" $'acct on '"$TEMP_DIR"$'/acct.log\necho logged | cat\nacct off\ncat '"$TEMP_DIR"$'/acct.log' '"cmd":"echo logged | cat"' "stdout"
+printf '%0200d\n' 0 > "$TEMP_DIR/par_long.txt" # jobs with longer command lines than parallel's own
+run_test_output "Acct: logs parallel itself" $'acct on '"$TEMP_DIR"$'/acct2.log\nparallel -a '"$TEMP_DIR"$'/par_long.txt echo\nacct off\ncat '"$TEMP_DIR"$'/acct2.log' '"cmd":"parallel -a '"$TEMP_DIR"'/par_long.txt echo","builtin":true' "stdout"
+
 # --- 7. Stress Tests (Potential Zombies/Crashes) ---
 echo -e "\n--- Testing Stress & Potential Issues ---"
-# Run many short background jobs quickly to stress SIGCHLD handler
+# Run many short background jobs quickly to stress reaping
 start_test "Stress: Multiple quick background jobs (&)"
 multi_bg_cmd=""
 for i in {1..20}; do multi_bg_cmd+="true & "; done
@@ -331,7 +440,7 @@ echo "  - Type 'sleep 0.2 &' several times (e.g., 5-10 times) rapidly."
 echo "  - Wait a second or two."
 echo "  - In *another* terminal window, run: ${BLUE}ps -u $USER | grep '[z] defunct'${RESET}"
 echo "  - (Replace $USER with your username if needed)."
-echo "  - ${GREEN}Expected:${RESET} No processes should be listed as '<defunct>'. If they appear briefly and disappear, the handler is working. If they persist, there's a problem."
+echo "  - ${GREEN}Expected:${RESET} No processes should be listed as '<defunct>'. If they appear briefly and disappear, reaping is working. If they persist, there's a problem."
 
 # --- Footer ---
 echo -e "\n==============================="